@@ -38,6 +38,18 @@
 #include "gyro_aided_tracker.h"
 #include "ORBDetectAndDespMatcher.h"
 #include "ORBextractor.h"
+#include "result_sink.h"
+#include "trace.h"
+#include "metrics.h"
+#include "stage_scope.h"
+#include "frame_arena.h"
+#include "tracking_mode_selector.h"
+#include "feature_budget.h"
+#include "frame_pool.h"
+#include "track_history.h"
+#include "keypoint_store.h"
+#include "viewer.h"
+#include "gap_detector.h"
 
 #include "common.h"
 
@@ -47,9 +59,16 @@ double time_cur = 0;
 double time_prev = 0;
 
 cv::Mat image_cur, image_cur_distort;
-Frame curFrame, lastFrame;
-Frame curFrameWithoutGeometryValid;  // used to display temporal tracked featrues
+FramePool framePool;    // recycled frames, the current and the last ones are swapped without copies
+TrackingContext trackingContext;    // frame and track ids and detection state of the image stream
+Frame* pLastFrame = framePool.Acquire();
 vector<IMU::Point> vImuMeas;        // IMU measurements from previous image to current image
+IMU::GyroIntegrator* pGyroIntegrator;   // integrates the gyro measurements as they arrive
+TrackingModeSelector trackingModeSelector;  // used when tracking_mode < 0 (auto)
+FeatureBudgetController* pFeatureBudget;    // number of features per frame, from the measured latency
+TrackHistory* pTrackHistory = NULL;         // past observations of the alive tracks, if track_history_length > 0
+Viewer* pViewer = NULL;     // draws the tracking results on its own thread
+GapDetector* pGapDetector = NULL;   // detects only in the cells which lack features, if detection_mode > 0
 
 std::string saveFolderPath;
 
@@ -62,14 +81,7 @@ string datasetDir;
 bool test_orb_detect_and_desp_matcher = false;
 ORB_SLAM2::ORBextractor *pORBextractorLeft, *pORBextractorRight;
 
-std::vector<std::pair<double, std::string>> vpTimeCorrespondens;
-
-void setFrameWithoutGeometryValid(Frame& frame, GyroAidedTracker& matcher)
-{
-    curFrameWithoutGeometryValid = Frame(frame);
-    matcher.SetBackToFrame(curFrameWithoutGeometryValid);
-    frame.SetCurFrameWithoutGeometryValid(&curFrameWithoutGeometryValid);
-}
+KeypointStore keypointStore;  // keypoints detected by SuperPoint, only used to compare with SuperGlue
 
 bool getNextFrame()
 {
@@ -151,6 +163,12 @@ int main(int argc, char **argv)
 
     loadConfigureFile(argv[1]);
     cout << "Tbc: " << imuCalib.Tbc << endl;
+    pGyroIntegrator = new IMU::GyroIntegrator(imuCalib);
+    pFeatureBudget = new FeatureBudgetController(keypoint_number, min_keypoint_number, latency_target, latency_percentile);
+    if(track_history_length > 0)
+        pTrackHistory = new TrackHistory(track_history_length, keypoint_number);
+    if(detection_mode > 0)
+        pGapDetector = new GapDetector(GapDetector::eDetector(detection_mode - 1), 2 * ORB_SLAM2::ORBextractor::CELL_SIZE);
 
     cv::FileStorage fSettings(argv[1], cv::FileStorage::READ);
     dataset = string(fSettings["dataset"]);
@@ -163,22 +181,21 @@ int main(int argc, char **argv)
     cout << "datasetDir: " << datasetDir << endl;
     cout << "output_file: " << output_file << endl;
     std::cout << "saveFolderPath: " << saveFolderPath << std::endl;
+    ResultSink::Create(saveFolderPath, ResultSink::eFormat(output_format));
+    pViewer = new Viewer(Viewer::eMode(viewer_mode), "Pixel-Aware Gyro-Aided KLT Feature Tracking",
+                         viewer_mode == Viewer::VIDEO? saveFolderPath + "tracking.avi": saveFolderPath + "images", pCameraParams->fps);
+    if(metrics_dump_period > 0)
+        MetricsRegistry::GetInstance()->StartPeriodicDump(saveFolderPath + "metrics.prom", metrics_dump_period);
+    ALLOC_INSTALL();
+    ALLOC_SET_BUDGET(30, alloc_budget_per_frame);  // 30 warm-up frames
 
     detectedKeypointsFile = path + detectedKeypointsFile;
     if(loadDetectedKeypoints){ // if Load keypoints from file. Default: not execute
-        std::string path = detectedKeypointsFile + "/corresponds.txt";
-        std::ifstream fin(path.c_str());
-        if(!fin.is_open()){
-            LOG(ERROR) << RED"open file failed. file: " << path << RESET;
-        }else {
-            std::string line;
-            while(getline(fin, line)){
-                std::string::size_type p_dot = line.find(",");
-                std::string t1_str = line.substr(0, p_dot), t2_str = line.substr(p_dot+2, line.size()-p_dot);
-                vpTimeCorrespondens.push_back(std::make_pair(std::atof(t1_str.c_str()), t2_str));
-            }
-        }
-        fin.close();
+        // the text files are converted once into a binary store next to them, which is then memory-mapped
+        const std::string storePath = detectedKeypointsFile + "/keypoints.bin";
+        if(!keypointStore.Open(storePath, detectedKeypointsFile) && (!KeypointStore::Convert(detectedKeypointsFile, storePath)
+                                                                     || !keypointStore.Open(storePath, detectedKeypointsFile)))
+            LOG(ERROR) << RED"open keypoint store failed. file: " << storePath << RESET;
     }
 
     // Initial ORBextractor
@@ -198,38 +215,40 @@ int main(int argc, char **argv)
     Timer timer;
     while(getNextFrame()){
         timer.freshTimer();
-        if(do_rectify)  // Default: not execute since D435i sequence provided in \data\ folder has been rectified
-            cv::remap(image_cur_distort, image_cur, pCameraParams->M1, pCameraParams->M2, cv::INTER_LINEAR);
-        else {
-            image_cur = image_cur_distort.clone();
-        }
+        // copied into the recycled frame by Frame::Init(), or rectified into it if do_rectify
+        // (Default: not rectify since D435i sequence provided in \data\ folder has been rectified)
+        image_cur = image_cur_distort;
 
         // Load IMU measurements
         if(time_prev != 0){
             while(last_imu.t < time_prev - MANUALLY_ADD_TIME_DELAY && getNextIMU(last_imu))
                 continue;
 
+            TRACE_SCOPE("LoadIMU");
             vImuMeas.clear();
             while(last_imu.t < time_cur - MANUALLY_ADD_TIME_DELAY && valid_imu){
                 vImuMeas.push_back(last_imu);
+                pGyroIntegrator->IntegrateNewMeasurement(last_imu);
                 valid_imu = getNextIMU(last_imu);
             }
         }
 
         // Feature tracking
-        curFrame = Frame(time_cur, image_cur, image_cur_distort, &lastFrame, pCameraParams, pORBextractorLeft, vImuMeas, keypoint_number, threshold_of_predict_new_keypoint);
+        Frame* pCurFrame = framePool.Acquire();
+        pCurFrame->Init(time_cur, image_cur, image_cur_distort, pLastFrame, pCameraParams, pORBextractorLeft, vImuMeas, pFeatureBudget->GetBudget(), threshold_of_predict_new_keypoint, &trackingContext, do_rectify);
+        Frame &curFrame = *pCurFrame, &lastFrame = *pLastFrame;
         if(lastFrame.mGray.empty()){    // if lastFrame is empty, then detect keypoints
             if(!loadDetectedKeypoints){ // Default: detect keypoints using ORBextractor
-                curFrame.DetectKeyPoints(pORBextractorLeft);
+                curFrame.DetectKeyPoints(pORBextractorLeft, pGapDetector);
             }else{  // else: Load keypoints from file. Default: not execute
-                int idx = findTimeCorrespondenIndex(vpTimeCorrespondens, curFrame.mTimeStamp);
+                int idx = keypointStore.Find(curFrame.mTimeStamp);
                 if (idx < 0){
                     LOG(ERROR) << "Can not find detected keypoints !!! Please check the setting of parameter - 'DetectedKeypointsFile'. curFrame.T: " << std::to_string(curFrame.mTimeStamp);
+                    framePool.Release(pCurFrame);
                     continue;
                 }
                 else {
-                    std::string path = detectedKeypointsFile + "/" + vpTimeCorrespondens[idx].second + ".txt";
-                    curFrame.LoadDetectedKeypointFromFile(detectedKeypointsFile);
+                    curFrame.LoadDetectedKeypoints(keypointStore.GetKeypoints(idx), keypointStore.GetKeypointNumber(idx));
                 }
             }
         }
@@ -237,43 +256,47 @@ int main(int argc, char **argv)
         int n_predict = 0;
         if(!lastFrame.mGray.empty())
         {
-            Timer timer;
+            TRACE_SCOPE("FeatureTracking");
             cv::Point3f biasg(0,0,0);
 
+            // Select the cheapest adequate tracking mode from the motion (auto), or use the configured one
+            cv::Mat Rcl = pGyroIntegrator->GetRcl(time_cur);
+            GyroAidedTracker::eType trackingType = GyroAidedTracker::eType(tracking_mode);
+            if(tracking_mode < 0)
+                trackingType = trackingModeSelector.Select(Rcl, vImuMeas, biasg, time_cur - time_prev);
+
             /// Pixel-Aware Gyro-Aided KLT Feature Tracking
             GyroAidedTracker gyroPredictMatcher(lastFrame, curFrame, imuCalib, biasg, cv::Mat(),
-                                                GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION,
+                                                trackingType,
                                                 GyroAidedTracker::PIXEL_AWARE_PREDICTION,
                                                 saveFolderPath, half_patch_size);
-
-            double t_instant_construct = timer.runTime_s(); timer.freshTimer();
+            gyroPredictMatcher.SetPredictedRcl(Rcl);
+            gyroPredictMatcher.SetGeometryValidation(GyroAidedTracker::eGeometryValidation(geometry_validation));
 
             n_predict = gyroPredictMatcher.TrackFeatures();
-            setFrameWithoutGeometryValid(curFrame, gyroPredictMatcher); // save temporal states
-            gyroPredictMatcher.GeometryValidation();
-            gyroPredictMatcher.SetBackToFrame(curFrame);
-            double t_track_features = timer.runTime_s(); timer.freshTimer();
+            int n_tracked = gyroPredictMatcher.GeometryValidation();
+            if(tracking_mode < 0)
+                trackingModeSelector.Update(gyroPredictMatcher, n_tracked);
+            gyroPredictMatcher.MoveResultsToFrame(curFrame);
 
             if(!loadDetectedKeypoints){ // Default: detcet new keypoint ORBextractorLeft
-                curFrame.DetectKeyPoints(pORBextractorLeft);
-                double t_detect_features = timer.runTime_s(); timer.freshTimer();
+                curFrame.DetectKeyPoints(pORBextractorLeft, pGapDetector);
 
-                int drawFlowType = 0;   // 0: draw flows on the current frame; 1: draw match line across two frames
-                bool bDrawPatch = true, bDrawMistracks = true, bDrawGyroPredictPosition = true;
-                curFrame.Display("Pixel-Aware Gyro-Aided KLT Feature Tracking", drawFlowType, bDrawPatch, bDrawMistracks, bDrawGyroPredictPosition);
+                Viewer::sOptions options;   // draw flows on the current frame, patches, mistracks and gyro predictions
+                pViewer->Push(curFrame, options);
 
             }else{// else load keypoints from file. Default: not execute
-                double t_detect_features = timer.runTime_s(); timer.freshTimer();
                 curFrame.SetPredictKeyPointsAndMask();
 
-                int drawFlowType = 0;   // 0: draw flows on the current frame; 1: draw match line across two frames
-                bool bDrawPatch = false, bDrawMistracks = true, bDrawGyroPredictPosition = false;
-                curFrame.Display("Pixel-Aware Gyro-Aided KLT Feature Tracking", drawFlowType, bDrawPatch, bDrawMistracks, bDrawGyroPredictPosition);
+                Viewer::sOptions options;
+                options.bDrawPatch = false;
+                options.bDrawGyroPredictPosition = false;
+                pViewer->Push(curFrame, options);
 
-                int idx = findTimeCorrespondenIndex(vpTimeCorrespondens, curFrame.mTimeStamp);
-                std::string path = detectedKeypointsFile + "/" + vpTimeCorrespondens[idx].second + ".txt";
+                int idx = keypointStore.Find(curFrame.mTimeStamp);
                 curFrame.Reset();
-                curFrame.LoadDetectedKeypointFromFile(path);
+                if(idx >= 0)
+                    curFrame.LoadDetectedKeypoints(keypointStore.GetKeypoints(idx), keypointStore.GetKeypointNumber(idx));
             }
 
             // test ORB feature detect and match for comparison
@@ -285,15 +308,26 @@ int main(int argc, char **argv)
                 matcher.Display();
             }
         }
+        if(pTrackHistory)
+            pTrackHistory->Update(curFrame);
+        STAGE_END_FRAME();
+        FrameArena::EndFrame();
         // end Feature tracking
 
         // update states
         {
-            lastFrame = Frame(curFrame);
+            STAGE_SCOPE("update_states");
+            // double buffering: the current frame becomes the last one, the old last one is recycled
+            framePool.Release(pLastFrame);
+            pCurFrame->mpLastFrame = NULL;
+            pLastFrame = pCurFrame;
             time_prev = time_cur;
+            pGyroIntegrator->Reset(time_cur);
             vImuMeas.clear();
         }
 
+        pFeatureBudget->Update(timer.runTime_ms());
+
         // sleep
         double t_total_us = timer.runTime_us();
         double t_sleep = pCameraParams->dt * 1e6 - t_total_us;
@@ -301,14 +335,14 @@ int main(int argc, char **argv)
             usleep(t_sleep);
 
         // button control
-        if(cv::waitKey(1) == 's')
+        if(pViewer->GetKey() == 's')
         {
             LOG(INFO) << "Enable step mode, please select the image show window "
                          "and then press null space button to step-continue or press 'q' to return to normal mode.";
             step_mode = true;
         }
         while (step_mode) {
-            int key = cv::waitKey(1);
+            int key = pViewer->GetKey();
             if(key == 'q') {
                 step_mode = false;
                 LOG(INFO) << "Noraml mode ...";
@@ -316,11 +350,15 @@ int main(int argc, char **argv)
             }else if(key == 32){ // Capture next frame.
                 break;
             }
+            usleep(1000);
         }
 
     }
 
-    return 0;
+    delete pViewer;     // draw the pending frame, and close the video
+    TRACE_EXPORT(saveFolderPath + "trace.json");
+    STAGE_REPORT();
+    return ALLOC_BUDGET_EXCEEDED()? 1: 0;
 }
 
 
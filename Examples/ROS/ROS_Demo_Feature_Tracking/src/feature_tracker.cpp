@@ -46,6 +46,18 @@
 #include "gyro_aided_tracker.h"
 #include "ORBDetectAndDespMatcher.h"
 #include "ORBextractor.h"
+#include "result_sink.h"
+#include "trace.h"
+#include "metrics.h"
+#include "stage_scope.h"
+#include "frame_arena.h"
+#include "tracking_mode_selector.h"
+#include "feature_budget.h"
+#include "frame_pool.h"
+#include "track_history.h"
+#include "keypoint_store.h"
+#include "viewer.h"
+#include "gap_detector.h"
 
 #include "common.h"
 
@@ -62,9 +74,16 @@ double time_prev = 0;
 bool data_valid = true;
 
 cv::Mat image_cur, image_cur_distort;
-Frame curFrame, lastFrame;
-Frame curFrameWithoutGeometryValid;  // used to display temporal tracked featrues
+FramePool framePool;    // recycled frames, the current and the last ones are swapped without copies
+TrackingContext trackingContext;    // frame and track ids and detection state of the image stream
+Frame* pLastFrame = framePool.Acquire();
 vector<IMU::Point> vImuMeas;        // IMU measurements from previous image to current image
+IMU::GyroIntegrator* pGyroIntegrator;   // integrates the gyro measurements as they arrive
+TrackingModeSelector trackingModeSelector;  // used when tracking_mode < 0 (auto)
+FeatureBudgetController* pFeatureBudget;    // number of features per frame, from the measured latency
+TrackHistory* pTrackHistory = NULL;         // past observations of the alive tracks, if track_history_length > 0
+Viewer* pViewer = NULL;     // draws the tracking results on its own thread
+GapDetector* pGapDetector = NULL;   // detects only in the cells which lack features, if detection_mode > 0
 
 std::string saveFolderPath;
 
@@ -74,16 +93,9 @@ bool do_rectify = true;
 bool test_orb_detect_and_desp_matcher = false;
 ORB_SLAM2::ORBextractor *pORBextractorLeft, *pORBextractorRight;
 
-std::vector<std::pair<double, std::string>> vpTimeCorrespondens;
+KeypointStore keypointStore;  // keypoints detected by SuperPoint, only used to compare with SuperGlue
 
 
-void setFrameWithoutGeometryValid(Frame& frame, GyroAidedTracker& matcher)
-{
-    curFrameWithoutGeometryValid = Frame(frame);
-    matcher.SetBackToFrame(curFrameWithoutGeometryValid);
-    frame.SetCurFrameWithoutGeometryValid(&curFrameWithoutGeometryValid);
-}
-
 cv::Mat getImageFromMsg(const sensor_msgs::ImageConstPtr &img_msg)
 {
     // Copy the ros image message to cv::Mat.
@@ -103,6 +115,7 @@ cv::Mat getImageFromMsg(const sensor_msgs::ImageConstPtr &img_msg)
 
 void sensorProcessTimer(const ros::TimerEvent& event)
 {
+    Timer timerFrame;   // end-to-end latency of the frame, fed back to the feature budget
     // deal with historical measurements
     if(!image_buf.empty() && !imu_buf.empty()){
         double old_imu_t = imu_buf.front()->header.stamp.toSec();
@@ -133,28 +146,8 @@ void sensorProcessTimer(const ros::TimerEvent& event)
             image_cur_distort = getImageFromMsg(image_buf.front());
             image_buf.pop();
 
-            if(do_rectify){
-                cv::remap(image_cur_distort, image_cur, pCameraParams->M1, pCameraParams->M2, cv::INTER_LINEAR);
-
-                /*// save rectified images
-                std::string::size_type pos = rosbag_file.rfind(".bag");
-                std::string dir = rosbag_file.substr(0,pos) + "/cam0_rectify/data/";
-                std::string command = "mkdir -p " + dir;
-                int a = system(command.c_str());
-                std::string path = dir + std::to_string(long(time_cur * 1e9)) + ".png";
-                cv::imwrite(path, image_cur);
-
-                std::ofstream fp_image_file_list(rosbag_file.substr(0,pos)+"/image_file_list.txt", std::ofstream::app);
-                if(!fp_image_file_list.is_open())
-                    std::cout << "cannot open: " << rosbag_file.substr(0,pos)+"/image_file_list.txt" << std::endl;
-                else {
-                    fp_image_file_list << "/cam0_rectify/data/" + std::to_string(long(time_cur * 1e9)) << ".png" << std::endl;
-                }
-                // end save rectified images
-                */
-            }
-            else
-                image_cur = image_cur_distort.clone();
+            // rectified and converted to gray by Frame::Init() in a single pass, into the recycled frame
+            image_cur = image_cur_distort;
         }
 
         // Load imu measurements
@@ -207,19 +200,21 @@ void sensorProcessTimer(const ros::TimerEvent& event)
     // Feature tracking
     if (data_valid)
     {
-        curFrame = Frame(time_cur, image_cur, image_cur_distort, &lastFrame, pCameraParams, pORBextractorLeft, vImuMeas, keypoint_number, threshold_of_predict_new_keypoint);
+        Frame* pCurFrame = framePool.Acquire();
+        pCurFrame->Init(time_cur, image_cur, image_cur_distort, pLastFrame, pCameraParams, pORBextractorLeft, vImuMeas, pFeatureBudget->GetBudget(), threshold_of_predict_new_keypoint, &trackingContext, do_rectify);
+        Frame &curFrame = *pCurFrame, &lastFrame = *pLastFrame;
         if(lastFrame.mGray.empty()){    // if lastFrame is empty, then detect keypoints
             if(!loadDetectedKeypoints){ // Default: detect keypoints using ORBextractor
-                curFrame.DetectKeyPoints(pORBextractorLeft);
+                curFrame.DetectKeyPoints(pORBextractorLeft, pGapDetector);
             }else{  // else: load keypoints from file. Default: not execute
-                int idx = findTimeCorrespondenIndex(vpTimeCorrespondens, curFrame.mTimeStamp);
+                int idx = keypointStore.Find(curFrame.mTimeStamp);
                 if (idx < 0){
                     LOG(ERROR) << "Can not find detected keypoints !!! Please check the setting of parameter - 'DetectedKeypointsFile'. curFrame.T: " << std::to_string(curFrame.mTimeStamp);
+                    framePool.Release(pCurFrame);
                     return;
                 }
                 else {
-                    std::string path = detectedKeypointsFile + "/" + vpTimeCorrespondens[idx].second + ".txt";
-                    curFrame.LoadDetectedKeypointFromFile(detectedKeypointsFile);
+                    curFrame.LoadDetectedKeypoints(keypointStore.GetKeypoints(idx), keypointStore.GetKeypointNumber(idx));
                 }
             }
         }
@@ -227,43 +222,47 @@ void sensorProcessTimer(const ros::TimerEvent& event)
         int n_predict = 0;
         if(!lastFrame.mGray.empty())
         {
-            Timer timer;
+            TRACE_SCOPE("FeatureTracking");
             cv::Point3f biasg(0,0,0);
 
+            // Select the cheapest adequate tracking mode from the motion (auto), or use the configured one
+            cv::Mat Rcl = pGyroIntegrator->GetRcl(time_cur);
+            GyroAidedTracker::eType trackingType = GyroAidedTracker::eType(tracking_mode);
+            if(tracking_mode < 0)
+                trackingType = trackingModeSelector.Select(Rcl, vImuMeas, biasg, time_cur - time_prev);
+
             /// Pixel-Aware Gyro-Aided KLT Feature Tracking
             GyroAidedTracker gyroPredictMatcher(lastFrame, curFrame, imuCalib, biasg, cv::Mat(),
-                                                GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION,
+                                                trackingType,
                                                 GyroAidedTracker::PIXEL_AWARE_PREDICTION,
                                                 saveFolderPath, half_patch_size);
-
-            double t_instant_construct = timer.runTime_s(); timer.freshTimer();
+            gyroPredictMatcher.SetPredictedRcl(Rcl);
+            gyroPredictMatcher.SetGeometryValidation(GyroAidedTracker::eGeometryValidation(geometry_validation));
 
             n_predict = gyroPredictMatcher.TrackFeatures();
-            setFrameWithoutGeometryValid(curFrame, gyroPredictMatcher); // save temporal states
-            gyroPredictMatcher.GeometryValidation();
-            gyroPredictMatcher.SetBackToFrame(curFrame);
-            double t_track_features = timer.runTime_s(); timer.freshTimer();
+            int n_tracked = gyroPredictMatcher.GeometryValidation();
+            if(tracking_mode < 0)
+                trackingModeSelector.Update(gyroPredictMatcher, n_tracked);
+            gyroPredictMatcher.MoveResultsToFrame(curFrame);
 
             if(!loadDetectedKeypoints){ // Default: detcet new keypoint ORBextractorLeft
-                curFrame.DetectKeyPoints(pORBextractorLeft);
-                double t_detect_features = timer.runTime_s(); timer.freshTimer();
+                curFrame.DetectKeyPoints(pORBextractorLeft, pGapDetector);
 
-                int drawFlowType = 0;   // 0: draw flows on the current frame; 1: draw match line across two frames
-                bool bDrawPatch = true, bDrawMistracks = true, bDrawGyroPredictPosition = true;
-                curFrame.Display("Pixel-Aware Gyro-Aided KLT Feature Tracking", drawFlowType, bDrawPatch, bDrawMistracks, bDrawGyroPredictPosition);
+                Viewer::sOptions options;   // draw flows on the current frame, patches, mistracks and gyro predictions
+                pViewer->Push(curFrame, options);
 
             }else{// else load keypoints from file. Default: not execute
-                double t_detect_features = timer.runTime_s(); timer.freshTimer();
                 curFrame.SetPredictKeyPointsAndMask();
 
-                int drawFlowType = 0;   // 0: draw flows on the current frame; 1: draw match line across two frames
-                bool bDrawPatch = false, bDrawMistracks = true, bDrawGyroPredictPosition = false;
-                curFrame.Display("Pixel-Aware Gyro-Aided KLT Feature Tracking", drawFlowType, bDrawPatch, bDrawMistracks, bDrawGyroPredictPosition);
+                Viewer::sOptions options;
+                options.bDrawPatch = false;
+                options.bDrawGyroPredictPosition = false;
+                pViewer->Push(curFrame, options);
 
-                int idx = findTimeCorrespondenIndex(vpTimeCorrespondens, curFrame.mTimeStamp);
-                std::string path = detectedKeypointsFile + "/" + vpTimeCorrespondens[idx].second + ".txt";
+                int idx = keypointStore.Find(curFrame.mTimeStamp);
                 curFrame.Reset();
-                curFrame.LoadDetectedKeypointFromFile(path);
+                if(idx >= 0)
+                    curFrame.LoadDetectedKeypoints(keypointStore.GetKeypoints(idx), keypointStore.GetKeypointNumber(idx));
             }
 
             // test ORB feature detect and match for comparison
@@ -275,14 +274,24 @@ void sensorProcessTimer(const ros::TimerEvent& event)
                 matcher.Display();
             }
         }
+        if(pTrackHistory)
+            pTrackHistory->Update(curFrame);
+        STAGE_END_FRAME();
+        FrameArena::EndFrame();
 
         // update states
         {
-            lastFrame = Frame(curFrame);
+            STAGE_SCOPE("update_states");
+            // double buffering: the current frame becomes the last one, the old last one is recycled
+            framePool.Release(pLastFrame);
+            pCurFrame->mpLastFrame = NULL;
+            pLastFrame = pCurFrame;
             time_prev = time_cur;
+            pGyroIntegrator->Reset(time_cur);
             vImuMeas.clear();
             data_valid = false;
         }
+        pFeatureBudget->Update(timerFrame.runTime_ms());
 
     } // End feature tracking
 }
@@ -297,6 +306,11 @@ void imuCallback(const sensor_msgs::ImuConstPtr &imu_msg)
                   << ", cur.t: " << std::to_string(imu_msg->header.stamp.toSec()) << ", IMU dt: " << imuCalib.dt << std::endl;
 
     imu_buf.push(imu_msg);
+
+    // integrate the rotation on arrival, so that Rcl is ready when the image lands
+    pGyroIntegrator->IntegrateNewMeasurement(IMU::Point(imu_msg->linear_acceleration.x, imu_msg->linear_acceleration.y, imu_msg->linear_acceleration.z,
+                                                        imu_msg->angular_velocity.x, imu_msg->angular_velocity.y, imu_msg->angular_velocity.z,
+                                                        imu_msg->header.stamp.toSec()));
 }
 
 void imageCallback(const sensor_msgs::ImageConstPtr &img_msg)
@@ -304,8 +318,16 @@ void imageCallback(const sensor_msgs::ImageConstPtr &img_msg)
     unique_lock<mutex> lock(mMutexImage);
 
     cnt ++;
-    if (cnt%downSampleRate == 0)
+    if (cnt%downSampleRate == 0){
+        // anchor the integrator at the first image, so that the IMU samples received before the image is processed
+        // are integrated into the Rcl of the second frame
+        static bool bIntegratorAnchored = false;
+        if(!bIntegratorAnchored){
+            pGyroIntegrator->Reset(img_msg->header.stamp.toSec());
+            bIntegratorAnchored = true;
+        }
         image_buf.push(img_msg);
+    }
 }
 
 int main(int argc, char **argv)
@@ -339,27 +361,32 @@ int main(int argc, char **argv)
 
     loadConfigureFile(argv[1]);
     cout << "Tbc: " << imuCalib.Tbc << endl;
+    pGyroIntegrator = new IMU::GyroIntegrator(imuCalib);
+    pFeatureBudget = new FeatureBudgetController(keypoint_number, min_keypoint_number, latency_target, latency_percentile);
+    if(track_history_length > 0)
+        pTrackHistory = new TrackHistory(track_history_length, keypoint_number);
+    if(detection_mode > 0)
+        pGapDetector = new GapDetector(GapDetector::eDetector(detection_mode - 1), 2 * ORB_SLAM2::ORBextractor::CELL_SIZE);
 
     // create folder for store the processing results
     char *path = getcwd(NULL, 0);
     saveFolderPath = path + output_file;
     std::cout << "saveFolderPath: " << saveFolderPath << std::endl;
+    ResultSink::Create(saveFolderPath, ResultSink::eFormat(output_format));
+    pViewer = new Viewer(Viewer::eMode(viewer_mode), "Pixel-Aware Gyro-Aided KLT Feature Tracking",
+                         viewer_mode == Viewer::VIDEO? saveFolderPath + "tracking.avi": saveFolderPath + "images", pCameraParams->fps);
+    if(metrics_dump_period > 0)
+        MetricsRegistry::GetInstance()->StartPeriodicDump(saveFolderPath + "metrics.prom", metrics_dump_period);
+    ALLOC_INSTALL();
+    ALLOC_SET_BUDGET(30, alloc_budget_per_frame);  // 30 warm-up frames
 
     detectedKeypointsFile = path + detectedKeypointsFile;
     if(loadDetectedKeypoints){ // if Load keypoints from file. Default: not execute
-        std::string path = detectedKeypointsFile + "/corresponds.txt";
-        std::ifstream fin(path.c_str());
-        if(!fin.is_open()){
-            std::cout << "open file failed. file: " << path << std::endl;
-        }else {
-            std::string line;
-            while(getline(fin, line)){
-                std::string::size_type p_dot = line.find(",");
-                std::string t1_str = line.substr(0, p_dot), t2_str = line.substr(p_dot+2, line.size()-p_dot);
-                vpTimeCorrespondens.push_back(std::make_pair(std::atof(t1_str.c_str()), t2_str));
-            }
-        }
-        fin.close();
+        // the text files are converted once into a binary store next to them, which is then memory-mapped
+        const std::string storePath = detectedKeypointsFile + "/keypoints.bin";
+        if(!keypointStore.Open(storePath, detectedKeypointsFile) && (!KeypointStore::Convert(detectedKeypointsFile, storePath)
+                                                                     || !keypointStore.Open(storePath, detectedKeypointsFile)))
+            LOG(ERROR) << RED"open keypoint store failed. file: " << storePath << RESET;
     }
 
     // initial ORBextractor
@@ -402,14 +429,14 @@ int main(int argc, char **argv)
                 if(sImage != NULL) imageCallback(sImage);
 
                 // button control
-                if(cv::waitKey(1) == 's')
+                if(pViewer->GetKey() == 's')
                 {
                     LOG(INFO) << "Enable step mode, please select the image show window "
                                  "and then press null space button to step-continue or press 'q' to return to normal mode.";
                     step_mode = true;
                 }
                 while (step_mode) {
-                    int key = cv::waitKey(1);
+                    int key = pViewer->GetKey();
                     if(key == 'q') {
                         step_mode = false;
                         LOG(INFO) << "Noraml mode ...";
@@ -430,7 +457,10 @@ int main(int argc, char **argv)
                 break;
         }
         bag.close();
-        return 0;
+        delete pViewer;     // draw the pending frame, and close the video
+        TRACE_EXPORT(saveFolderPath + "trace.json");
+        STAGE_REPORT();
+        return ALLOC_BUDGET_EXCEEDED()? 1: 0;
     }
     ////////////////////////////////////////////////////////////
 
@@ -440,7 +470,10 @@ int main(int argc, char **argv)
     ros::Subscriber sub_img0 = nh.subscribe(image_topic, 200, imageCallback);
 
     ros::spin();
-    return 0;
+    delete pViewer;
+    TRACE_EXPORT(saveFolderPath + "trace.json");
+    STAGE_REPORT();
+    return ALLOC_BUDGET_EXCEEDED()? 1: 0;
 }
 
 
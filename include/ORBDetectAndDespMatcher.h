@@ -37,6 +37,8 @@
 
 #include "ORBextractor.h"
 
+class ResultSink;
+
 using namespace std;
 
 class ORBDetectAndDespMatcher{
@@ -53,8 +55,6 @@ public:
     void PoseEstimation2d2d();
     void Display();
 
-    void SaveMsgToFile(std::string filename, std::string &msg);
-
 private:
     cv::Point2d Pixel2Cam(const cv::Point2d& p){
         // x= (px -cx)/fx, y = (py-cy) / fy
@@ -89,6 +89,7 @@ protected:
     ORB_SLAM2::ORBextractor* mpORBextractorRight;
 
     std::string mSaveFolderPath;
+    ResultSink* mpResultSink;   // sink of mSaveFolderPath, NULL if the results are not saved
 };
 
 
@@ -46,6 +46,9 @@
 #include <list>
 #include <opencv/cv.h>
 
+#include "frame_arena.h"
+#include "occupancy_grid.h"
+
 
 namespace ORB_SLAM2
 {
@@ -57,9 +60,9 @@ public:
 
     void DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4);
 
-    std::vector<cv::KeyPoint> vKeys;
+    ArenaVector<cv::KeyPoint> vKeys;    // the nodes only live during DistributeOctTree()
     cv::Point2i UL, UR, BL, BR;
-    std::list<ExtractorNode>::iterator lit;
+    std::list<ExtractorNode, ArenaAllocator<ExtractorNode> >::iterator lit;
     bool bNoMore;
 };
 
@@ -95,6 +98,13 @@ public:
     void DetectFeatures(cv::InputArray image, cv::InputArray mask,
                         std::vector<cv::KeyPoint>& keypoints);
 
+    // Only detect ORB features out of the occupied cells. FAST is not run on the fully occupied regions.
+    void DetectFeatures(cv::InputArray image, const OccupancyGrid &occupancy,
+                        std::vector<cv::KeyPoint>& keypoints);
+
+    // Side of the cells in which FAST is run, at each level
+    static const int CELL_SIZE = 30;
+
     int inline GetLevels(){
         return nlevels;}
 
@@ -122,8 +132,11 @@ public:
 protected:
 
     void ComputePyramid(cv::Mat image);
-    void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
-    std::vector<cv::KeyPoint> DistributeOctTree(const std::vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
+    void ComputeKeyPointsOctTree(std::vector<std::vector<cv::KeyPoint> >& allKeypoints,
+                                 const OccupancyGrid* pOccupancy = NULL);
+    void DetectFeatures(const cv::Mat &image, const cv::Mat &mask, const OccupancyGrid* pOccupancy,
+                        std::vector<cv::KeyPoint>& keypoints);
+    std::vector<cv::KeyPoint> DistributeOctTree(const ArenaVector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                                 const int &maxX, const int &minY, const int &maxY, const int &nFeatures, const int &level);
 
     void ComputeKeyPointsOld(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
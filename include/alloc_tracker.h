@@ -0,0 +1,104 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ALLOCTRACKER_H
+#define ALLOCTRACKER_H
+
+/**
+ * Heap allocation accounting per pipeline stage.
+ * The global operator new/delete are replaced and a counting cv::MatAllocator is installed,
+ * every allocation is attributed to the innermost ALLOC_SCOPE of the calling thread ("other" if none).
+ * Only the allocations are counted (number and bytes), not the frees.
+ *
+ *     ALLOC_INSTALL();                    // once, before the processing (installs the cv::Mat allocator)
+ *     ALLOC_SET_BUDGET(30, 2000);         // after 30 warm-up frames, more than 2000 allocations per frame is a regression
+ *     ...
+ *     ALLOC_END_FRAME();                  // per-frame totals to the metrics registry, check the budget
+ *     return ALLOC_BUDGET_EXCEEDED()? 1: 0;
+ *
+ * Compiled out unless ENABLE_ALLOC_TRACKING is defined (cmake -DENABLE_ALLOC_TRACKING=ON).
+ */
+
+#ifdef ENABLE_ALLOC_TRACKING
+
+#include <stdint.h>
+#include <stddef.h>
+
+class AllocTracker
+{
+public:
+    static const int MAX_STAGES = 32;
+
+    // Return the stage id. The name must be a string literal.
+    static int RegisterStage(const char* name);
+
+    // Set the stage of the calling thread, return the previous one
+    static int SetCurrentStage(int stage);
+
+    static void Count(size_t bytes);
+
+    static void InstallMatAllocator();
+
+    // A steady-state frame (after warmupFrames) allocating more than maxPerFrame times is a regression. 0: no check.
+    static void SetBudget(int warmupFrames, uint64_t maxPerFrame);
+
+    static void EndFrame();
+    static bool BudgetExceeded();
+    static void Report();
+};
+
+class AllocScope
+{
+public:
+    explicit AllocScope(int stage) {mPrevious = AllocTracker::SetCurrentStage(stage);}
+    ~AllocScope() {AllocTracker::SetCurrentStage(mPrevious);}
+
+private:
+    AllocScope(const AllocScope&);
+    AllocScope& operator=(const AllocScope&);
+
+    int mPrevious;
+};
+
+#define ALLOC_CONCAT_IMPL(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_IMPL(a, b)
+#define ALLOC_SCOPE(name) \
+    static const int ALLOC_CONCAT(allocStage_, __LINE__) = AllocTracker::RegisterStage(name); \
+    AllocScope ALLOC_CONCAT(allocScope_, __LINE__)(ALLOC_CONCAT(allocStage_, __LINE__))
+#define ALLOC_INSTALL() AllocTracker::InstallMatAllocator()
+#define ALLOC_SET_BUDGET(warmupFrames, maxPerFrame) AllocTracker::SetBudget(warmupFrames, maxPerFrame)
+#define ALLOC_END_FRAME() AllocTracker::EndFrame()
+#define ALLOC_BUDGET_EXCEEDED() AllocTracker::BudgetExceeded()
+#define ALLOC_REPORT() AllocTracker::Report()
+
+#else
+
+#define ALLOC_SCOPE(name) ((void)0)
+#define ALLOC_INSTALL() ((void)0)
+#define ALLOC_SET_BUDGET(warmupFrames, maxPerFrame) ((void)0)
+#define ALLOC_END_FRAME() ((void)0)
+#define ALLOC_BUDGET_EXCEEDED() false
+#define ALLOC_REPORT() ((void)0)
+
+#endif // ENABLE_ALLOC_TRACKING
+
+#endif // ALLOCTRACKER_H
@@ -0,0 +1,123 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's array based queue).
+ * Every cell carries a sequence number which tells whether it is ready to be written or read,
+ * so that TryPush() and TryPop() only need one compare-and-swap on the position.
+ * The capacity is rounded up to a power of two. TryPush() fails instead of blocking when the queue is full.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity): mnEnqueuePos(0), mnDequeuePos(0)
+    {
+        size_t n = 2;
+        while(n < capacity) n <<= 1;
+        mnMask = n - 1;
+        mvCells = std::vector<Cell>(n);
+        for(size_t i = 0; i < n; i++)
+            mvCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool TryPush(const T &data)
+    {
+        Cell *cell;
+        size_t pos = mnEnqueuePos.load(std::memory_order_relaxed);
+        while(true){
+            cell = &mvCells[pos & mnMask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+            if(dif == 0){
+                if(mnEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+                return false;   // full
+            else
+                pos = mnEnqueuePos.load(std::memory_order_relaxed);
+        }
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T &data)
+    {
+        Cell *cell;
+        size_t pos = mnDequeuePos.load(std::memory_order_relaxed);
+        while(true){
+            cell = &mvCells[pos & mnMask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+            if(dif == 0){
+                if(mnDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+                return false;   // empty
+            else
+                pos = mnDequeuePos.load(std::memory_order_relaxed);
+        }
+        data = cell->data;
+        cell->sequence.store(pos + mnMask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Whether the next TryPop() would fail. Exact for the single consumer, a hint for the others.
+    bool IsEmpty() const
+    {
+        const size_t pos = mnDequeuePos.load(std::memory_order_relaxed);
+        return mvCells[pos & mnMask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    size_t Capacity() const {return mnMask + 1;}
+
+private:
+    struct Cell
+    {
+        Cell() {}
+        Cell(const Cell &c): sequence(c.sequence.load()), data(c.data) {}
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    BoundedQueue(const BoundedQueue&);
+    BoundedQueue& operator=(const BoundedQueue&);
+
+    std::vector<Cell> mvCells;
+    size_t mnMask;
+    char mPad0[64];     // keep the producer and consumer positions on different cache lines
+    std::atomic<size_t> mnEnqueuePos;
+    char mPad1[64];
+    std::atomic<size_t> mnDequeuePos;
+};
+
+#endif // BOUNDEDQUEUE_H
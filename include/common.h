@@ -42,6 +42,17 @@ IMU::Calib imuCalib;
 int keypoint_number;
 float threshold_of_predict_new_keypoint;
 int half_patch_size = 5;
+int geometry_validation = 0;    // GyroAidedTracker::eGeometryValidation
+int tracking_mode = 4;          // GyroAidedTracker::eType, -1: auto, selected per frame by TrackingModeSelector
+int output_format = 0;          // ResultSink::eFormat, 0: CSV, 1: binary
+float metrics_dump_period = 0;  // seconds, 0: do not dump the metrics
+int alloc_budget_per_frame = 0; // heap allocations per frame, 0: no check. Needs ENABLE_ALLOC_TRACKING
+float latency_target = 0;       // ms, end-to-end latency kept by the feature budget controller, 0: fixed KeyPointNumber
+float latency_percentile = 0.9; // percentile of the latency compared with latency_target
+int min_keypoint_number = 0;    // lower bound of the feature budget, 0: KeyPointNumber / 4
+int track_history_length = 0;   // samples kept per track by TrackHistory, 0: off
+int viewer_mode = 1;            // Viewer::eMode, 0: off, 1: window, 2: video (tracking.avi), 3: images (images/)
+int detection_mode = 0;         // 0: whole image (ORBextractor), 1: gap-filling FAST, 2: gap-filling Shi-Tomasi
 
 bool loadDetectedKeypoints = false;
 string detectedKeypointsFile;
@@ -82,7 +93,11 @@ void loadConfigureFile(const std::string &file)
     if(!node.empty() && node.isReal()) k3 = float(node);
     int width = fSettings["Camera.width"]; int height = fSettings["Camera.height"];
     int fps = fSettings["Camera.fps"];
-    pCameraParams = new CameraParams(type, fx, fy, cx, cy, k1, k2, p1, p2, k3, width, height, fps);
+    string map_cache;   // cache file of the rectification maps, empty: computed at each start
+    node = fSettings["RectifyMapCache"];
+    if (!node.empty())  map_cache = string(node);
+    std::cout << "rectify_map_cache: " << map_cache << std::endl;
+    pCameraParams = new CameraParams(type, fx, fy, cx, cy, k1, k2, p1, p2, k3, width, height, fps, map_cache);
 
     // IMU calibration (Tbc, Tcb, noise)
     float ng = fSettings["IMU.NoiseGyro"]; float na = fSettings["IMU.NoiseAcc"];
@@ -100,17 +115,60 @@ void loadConfigureFile(const std::string &file)
     keypoint_number = fSettings["KeyPointNumber"];
     threshold_of_predict_new_keypoint = fSettings["ThresholdOfPredictNewKeyPoint"];
     half_patch_size = fSettings["HalfPatchSize"];
-}
 
-int findTimeCorrespondenIndex(std::vector<std::pair<double, std::string>>& vpTimeString, double& t) // only used to compare with SuperGlue
-{
-    for(int i = 0; i < vpTimeString.size(); i++)
-    {
-        auto p = vpTimeString[i];
-        if(std::abs(t - p.first) < 0.0001)
-            return i;   // found
+    // geometry validation method
+    node = fSettings["GeometryValidation"];
+    if (!node.empty())  geometry_validation = int(node);
+    std::cout << "geometry_validation: " << geometry_validation << std::endl;
+
+    // tracking mode
+    node = fSettings["TrackingMode"];
+    if (!node.empty())  tracking_mode = int(node);
+    if (tracking_mode < -1 || tracking_mode > 6) {  // GyroAidedTracker::eType is in [0, 6]
+        std::cout << "unknown tracking_mode " << tracking_mode << ", use 4" << std::endl;
+        tracking_mode = 4;
     }
-    return -1;  // not found
+    std::cout << "tracking_mode: " << tracking_mode << std::endl;
+
+    // format of the saved results
+    node = fSettings["OutputFormat"];
+    if (!node.empty())  output_format = int(node);
+    std::cout << "output_format: " << output_format << std::endl;
+
+    // period of dumping the metrics (Prometheus text format)
+    node = fSettings["MetricsDumpPeriod"];
+    if (!node.empty())  metrics_dump_period = float(node);
+    std::cout << "metrics_dump_period: " << metrics_dump_period << std::endl;
+
+    // steady-state heap allocation budget per frame
+    node = fSettings["AllocationBudgetPerFrame"];
+    if (!node.empty())  alloc_budget_per_frame = int(node);
+
+    // closed-loop feature budget
+    node = fSettings["LatencyTarget"];
+    if (!node.empty())  latency_target = float(node);
+    node = fSettings["LatencyPercentile"];
+    if (!node.empty())  latency_percentile = float(node);
+    node = fSettings["MinKeyPointNumber"];
+    if (!node.empty())  min_keypoint_number = int(node);
+    if (min_keypoint_number <= 0)  min_keypoint_number = keypoint_number / 4;
+    std::cout << "latency_target: " << latency_target << ", latency_percentile: " << latency_percentile
+              << ", min_keypoint_number: " << min_keypoint_number << std::endl;
+
+    // per-track history ring
+    node = fSettings["TrackHistoryLength"];
+    if (!node.empty())  track_history_length = int(node);
+    std::cout << "track_history_length: " << track_history_length << std::endl;
+
+    // visualization
+    node = fSettings["ViewerMode"];
+    if (!node.empty())  viewer_mode = int(node);
+    std::cout << "viewer_mode: " << viewer_mode << std::endl;
+
+    // detection of the new keypoints
+    node = fSettings["DetectionMode"];
+    if (!node.empty())  detection_mode = int(node);
+    std::cout << "detection_mode: " << detection_mode << std::endl;
 }
 
 #endif // COMMON_H
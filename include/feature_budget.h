@@ -0,0 +1,72 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEATUREBUDGET_H
+#define FEATUREBUDGET_H
+
+#include <vector>
+#include <stddef.h>
+
+/**
+ * Closed-loop controller of the number of features per frame, which keeps a percentile of the measured
+ * end-to-end latency near a target. The budget is passed to the Frame as its keypoint number, so it
+ * bounds both the tracks carried to the next frame (the tracker's input set) and the number of new
+ * keypoints detected by Frame::DetectKeyPoints(). It never goes below the minimum number of features.
+ *
+ *     Frame(..., controller.GetBudget(), ...);
+ *     ...
+ *     controller.Update(latency_ms);      // at the end of the frame
+ *
+ * The budget decreases quickly when the latency percentile exceeds the target and increases slowly
+ * below a dead band, so that the frames do not oscillate between the two regimes.
+ */
+class FeatureBudgetController
+{
+public:
+    // targetLatency <= 0 disables the controller, then GetBudget() always returns maxFeatures
+    FeatureBudgetController(int maxFeatures, int minFeatures, float targetLatency,
+                            float percentile = 0.9f, int window = 30);
+
+    void Update(float latency);
+
+    int GetBudget() const {return mnBudget;}
+    bool IsEnabled() const {return mfTargetLatency > 0;}
+
+    // Percentile of the latencies in the window, -1 if there is no sample
+    float GetLatencyPercentile() const;
+
+private:
+    int mnMaxFeatures;
+    int mnMinFeatures;
+    float mfTargetLatency;
+    float mfPercentile;
+
+    int mnBudget;
+    float mfBudget;     // continuous budget, rounded to mnBudget
+
+    std::vector<float> mvLatencies;         // ring buffer of the last latencies
+    size_t mnNext;
+    size_t mnSamples;
+    mutable std::vector<float> mvSorted;    // scratch for the percentile
+};
+
+#endif // FEATUREBUDGET_H
@@ -0,0 +1,89 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEATURETABLE_H
+#define FEATURETABLE_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "utils.h"
+
+/**
+ * Structure-of-arrays storage of the per-feature tracking state, indexed by the keypoint index in
+ * the reference frame. Filled by GyroAidedTracker and PatchMatch, then moved into the current Frame.
+ * Each attribute is a contiguous float array, so the per-feature loops read only what they use.
+ * The flags are bitsets, thus the parallel loops must split the features in blocks of BLOCK_SIZE
+ * (see BlockToFeatures()) so that each word is written by one thread only.
+ */
+class FeatureTable
+{
+public:
+    static const int BLOCK_SIZE = 64;
+    static const int CORNERS = 4;   // corners of the patch window: top left, top right, bottom left, bottom right
+
+    FeatureTable() {Resize(0);}
+
+    // Resize and reset all the attributes (positions to zero, affine matrices to identity, flags cleared)
+    void Resize(size_t n);
+    size_t size() const {return mN;}
+    bool empty() const {return mN == 0;}
+    void swap(FeatureTable &t);
+
+    int NumBlocks() const {return int((mN + BLOCK_SIZE - 1) / BLOCK_SIZE);}
+    cv::Range BlockToFeatures(const cv::Range &blocks) const {
+        return cv::Range(blocks.start * BLOCK_SIZE, std::min(int(mN), blocks.end * BLOCK_SIZE));
+    }
+
+    cv::Matx22f Affine(size_t i) const {return cv::Matx22f(a11[i], a12[i], a21[i], a22[i]);}
+    void SetAffine(size_t i, const cv::Matx22f &A) {a11[i] = A(0,0); a12[i] = A(0,1); a21[i] = A(1,0); a22[i] = A(1,1);}
+
+    // Adapters from/to the keypoint and point vectors
+    void SetReference(const std::vector<cv::KeyPoint> &vKeysUn);
+    void GetPredicted(std::vector<cv::Point2f> &vPts, std::vector<cv::Point2f> &vPtsUn) const;
+    void SetPredicted(const std::vector<cv::Point2f> &vPts, const std::vector<cv::Point2f> &vPtsUn);
+    void GetGyroPredictedUn(std::vector<cv::Point2f> &vPtsUn) const;
+    void GetStatus(const BitMask &flags, std::vector<uchar> &vStatus) const;
+    void SetStatus(const std::vector<uchar> &vStatus, BitMask &flags);
+
+public:
+    std::vector<float> uRef, vRef;          // Undistorted keypoints of the reference frame
+    std::vector<float> uPred, vPred;        // Predicted pixels (Distorted)
+    std::vector<float> uPredUn, vPredUn;    // Predicted pixels (Undistorted)
+    std::vector<float> uGyroUn, vGyroUn;    // Pixels predicted by the gyro only (Undistorted)
+    std::vector<float> uFlow, vFlow;        // Flows of gyro. predict (Undistorted)
+    std::vector<float> uCorner[CORNERS], vCorner[CORNERS];  // Predicted patch corners relative to the predicted pixel
+    std::vector<float> a11, a12, a21, a22;  // Affine deformation matrix. A = [1 + dxx, dxy; dyx, 1 + dyy]
+    std::vector<float> uMatch, vMatch;      // Pixels refined by patch match (Distorted)
+    std::vector<float> uMatchUn, vMatchUn;  // Pixels refined by patch match (Undistorted)
+    std::vector<float> ncc;                 // Zero-normalized cross correlation of the matched patches
+    std::vector<float> error;               // Pixel errors of the matched patches
+
+    BitMask predicted;      // 1: predicted inside the image
+    BitMask matched;        // 1: patch match converged
+    BitMask tracked;        // 1: accepted
+
+private:
+    size_t mN;
+};
+
+#endif // FEATURETABLE_H
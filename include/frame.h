@@ -23,47 +23,72 @@
 #ifndef FRAME_H
 #define FRAME_H
 
+#include <stdint.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
 #include "imu_types.h"
 #include "ORBextractor.h"
+#include "feature_table.h"
+#include "occupancy_grid.h"
+#include "tracking_context.h"
+#include "gap_detector.h"
+#include "gray_rectifier.h"
 
 class Frame
 {
 public:
     Frame();
     Frame(const Frame& frame);
+    Frame(Frame&& frame) = default;
+    Frame& operator=(Frame&& frame) = default;
     Frame(double &t, cv::Mat &im, cv::Mat &im_dist, Frame* pLastFrame, CameraParams *pCameraParams,
           ORB_SLAM2::ORBextractor* pORBextractor,
-          std::vector<IMU::Point> &vImu, int keypointNumber = 512, double th = 1.0);
-
-    void DetectKeyPoints(ORB_SLAM2::ORBextractor* pORBextractor);
+          std::vector<IMU::Point> &vImu, int keypointNumber = 512, double th = 1.0,
+          TrackingContext* pContext = NULL);
+
+    // Re-initialize a recycled frame (see FramePool) for a new image. Same arguments as the constructor,
+    // but the gray image, the mask and the vectors reuse their buffers instead of being reallocated.
+    // The ids are drawn from the context of the stream (TrackingContext::GetDefault() if NULL).
+    // If bRectify, im is the raw input, rectified with the maps of the camera and converted to gray in one pass.
+    void Init(double t, const cv::Mat &im, const cv::Mat &im_dist, Frame* pLastFrame, CameraParams *pCameraParams,
+              ORB_SLAM2::ORBextractor* pORBextractor,
+              const std::vector<IMU::Point> &vImu, int keypointNumber = 512, double th = 1.0,
+              TrackingContext* pContext = NULL, bool bRectify = false);
+
+    // Detect new keypoints with the ORBextractor (or cv::goodFeaturesToTrack if NULL) over the whole image,
+    // or only in the cells which lack features if a GapDetector is given
+    void DetectKeyPoints(ORB_SLAM2::ORBextractor* pORBextractor, GapDetector* pGapDetector = NULL);
 
     // read features from file. the feature is detected by SuperPoint (Paper - "SuperPoint: Self-supervised interest point detection and description")
     void LoadDetectedKeypointFromFile(std::string path);
 
+    // same as above, from the keypoints of a KeypointStore (zero-copy)
+    void LoadDetectedKeypoints(const cv::Point2f* pPts, int n);
+
     void UndistortPoints(std::vector<cv::Point2f> &corners);
 
     //void Display(std::string winname);
+    // Draw and show the tracking results synchronously, for debugging. The drivers use a Viewer instead.
     void Display(std::string winname, int drawFlowType, bool bDrawPatch, bool bDrawMistracks, bool bDrawGyroPredictPosition=true);
 
-    void SetCurFrameWithoutGeometryValid(Frame* pframe) {curFrameWithoutGeometryValid = pframe;}
-
     void SetPredictKeyPointsAndMask();
 
+    // Full-resolution detection mask (1: free, 0: occupied by a tracked feature), for debugging
+    cv::Mat GetMask() const {return mOccupancy.GetMask();}
+
     void Reset();
 
 public:
-    static long unsigned int nNextId;
+    TrackingContext* mpContext; // stream of the frame
 
     long unsigned int mnId;
     int mN;     // KeyPoints number
     double mThresholdOfPredictNewKeyPoint;
     double mTimeStamp;
     cv::Mat mGray;          // rectified
-    cv::Mat mGrayDistort;   // original distorted image, just used for display
+    cv::Mat mGrayDistort;   // original distorted image (shared with the input, not copied), just used for display.
+                            // Empty unless TrackingContext::mbRetainDistortedImage is set
     Frame *mpLastFrame;
-    Frame *curFrameWithoutGeometryValid;
 
     cv::Mat mRcl;
     CameraParams *mpCameraParams;
@@ -76,19 +101,22 @@ public:
     std::vector<cv::Point2f> mvFlowVelocityInNormalPlane;   // Note: the flow velocity is calculated only
                                                             // when the corresponding feature is successfully
                                                             // tracked in its next frame.
-    cv::Mat mMask;
+    OccupancyGrid mOccupancy;   // cells occupied by the tracked features, new keypoints are only detected out of them
     std::vector<int> mvPtIndexInLastFrame;  // The index of the corresponding features in the reference frame.
                                             // Note: if >= 0, the ndex of the corresponding features
                                             //       else if < 0, the keypoints are new detected.
+    std::vector<uint64_t> mvTrackIds;       // Persistent id of the track of each keypoint, assigned at detection
+                                            // and carried to the next frames while the feature is tracked.
 
     std::vector<cv::Point2f> mvPtPredict;   // Pixels predicted from reference frame. (Distorted)
     std::vector<cv::Point2f> mvPtPredictUn; // Pixels predicted from reference frame. (Undistorted)
     std::vector<cv::Point2f> mvPtGyroPredictUn; // Pixels predicted from reference frame.
     std::vector<uchar> mvStatus;            // States. 1: valid predict; 0: unvalid predict
                                             // Note: the vector size is equal to the keypoint number of reference frame
-    std::vector<float> mvNcc;
+    std::vector<uchar> mvStatusWithoutGeometryValid;    // States before geometry validation, used for display
 
-    std::vector<std::vector<cv::Point2f>> mvvFlowsPredictCorners;
+    FeatureTable mTracks;   // Tracking state from the last frame (patch corners, affine matrices, ncc, ...),
+                            // indexed by the keypoints of the last frame
 };
 
 #endif // FRAME_H
@@ -0,0 +1,162 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+/**
+ * Frame-scoped monotonic arena for the transient data of the tracking pipeline.
+ * Each thread allocates from its own arena (no locks). The memory is never freed individually,
+ * the tracking thread resets its arena at the end of the frame and the worker threads rewind theirs
+ * with an ArenaScope around each task, so the blocks are reused: after the first frames the hot path
+ * does not call malloc and the memory use is bounded by the peak of one frame.
+ *
+ *     ArenaVector<float> vErrors(N);          // allocated from the arena of the calling thread
+ *     {
+ *         ArenaScope scope;                   // rewinds the arena at the end of the scope,
+ *         ArenaVector<int> vTmp(M);           // e.g., per-feature scratch inside a parallel loop
+ *     }
+ *     ...
+ *     FrameArena::EndFrame();                 // once per frame on the tracking thread of the stream,
+ *                                             // when no arena-backed object of this thread is alive
+ *
+ * Only the objects that are created and destroyed within the frame (or the ArenaScope) may use the arena,
+ * and an arena-backed container must grow on the thread that created it. A task running on a worker
+ * thread (ThreadPool, cv::parallel_for_) must put its arena allocations in an ArenaScope, nothing resets
+ * the worker arenas otherwise.
+ */
+
+#include <vector>
+#include <atomic>
+#include <stddef.h>
+
+class FrameArena
+{
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+
+    struct sMarker{
+        size_t nBlock;
+        size_t nOffset;
+        size_t nUsedBefore;
+    };
+
+    explicit FrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~FrameArena();
+
+    void* Allocate(size_t bytes, size_t alignment);
+
+    // Rewind to the beginning. Keep the memory, the blocks of a multi-block frame are merged into one.
+    void Reset();
+
+    sMarker GetMarker() const {sMarker m = {mnBlock, mnOffset, mnUsedBefore}; return m;}
+    void Rewind(const sMarker &m);
+
+    size_t GetPeakBytes() const {return mnPeakBytes.load(std::memory_order_relaxed);}
+    size_t GetReservedBytes() const;
+
+    // Called by ArenaScope, the arena must not be reset while a scope is open
+    void OpenScope();
+    void CloseScope(const sMarker &m);
+
+    // The arena of the calling thread
+    static FrameArena* GetThreadLocal();
+
+    // Reset the arena of the calling thread (the frame boundary of its stream, no ArenaScope may be open)
+    // and record the peak memory of the frame. The arenas of the other threads are not touched.
+    static void EndFrame();
+
+private:
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+
+    struct sBlock{
+        char* pData;
+        size_t nSize;
+    };
+
+    void* AllocateNewBlock(size_t bytes, size_t alignment);
+
+    size_t mnBlockSize;
+    std::vector<sBlock> mvBlocks;
+    size_t mnBlock;     // current block
+    size_t mnOffset;    // offset in the current block
+    size_t mnUsedBefore;    // size of the blocks before the current one
+    int mnScopes;       // open ArenaScopes
+    std::atomic<size_t> mnPeakBytes;    // peak of the current frame, read by EndFrame()
+    std::atomic<size_t> mnReservedBytes;    // published for EndFrame(), the blocks belong to the owner thread
+};
+
+// Rewind the arena of the calling thread at the end of the scope
+class ArenaScope
+{
+public:
+    ArenaScope(): mpArena(FrameArena::GetThreadLocal()), mMarker(mpArena->GetMarker()) {mpArena->OpenScope();}
+    ~ArenaScope() {mpArena->CloseScope(mMarker);}
+
+    FrameArena* GetArena() const {return mpArena;}
+
+private:
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator=(const ArenaScope&);
+
+    FrameArena* mpArena;
+    FrameArena::sMarker mMarker;
+};
+
+// Standard allocator on a FrameArena, deallocate() is a no-op
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<typename U> struct rebind {typedef ArenaAllocator<U> other;};
+
+    ArenaAllocator(): mpArena(FrameArena::GetThreadLocal()) {}
+    explicit ArenaAllocator(FrameArena* pArena): mpArena(pArena) {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U> &a): mpArena(a.GetArena()) {}
+
+    T* allocate(size_t n) {return static_cast<T*>(mpArena->Allocate(n * sizeof(T), alignof(T)));}
+    void deallocate(T*, size_t) {}
+
+    FrameArena* GetArena() const {return mpArena;}
+
+private:
+    FrameArena* mpArena;
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {return a.GetArena() == b.GetArena();}
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {return a.GetArena() != b.GetArena();}
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif // FRAMEARENA_H
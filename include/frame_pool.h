@@ -0,0 +1,61 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <vector>
+#include <memory>
+#include "frame.h"
+
+/**
+ * Pool of recycled frames. A released frame keeps its buffers (gray image, mask, keypoint vectors),
+ * which are reused by Frame::Init() when the frame is acquired again, so the steady state does not
+ * allocate nor copy images when the current frame becomes the last one (double buffering):
+ *
+ *     Frame* pCurFrame = framePool.Acquire();
+ *     pCurFrame->Init(t, im, im_dist, pLastFrame, ...);
+ *     ...
+ *     framePool.Release(pLastFrame);
+ *     pLastFrame = pCurFrame;
+ *
+ * The pool grows when all the frames are in use. It is not thread-safe.
+ */
+class FramePool
+{
+public:
+    explicit FramePool(size_t n = 2);
+
+    Frame* Acquire();
+    void Release(Frame* pFrame);
+
+    size_t Size() const {return mvpFrames.size();}
+
+private:
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+
+    std::vector<std::unique_ptr<Frame> > mvpFrames;    // all the frames, owned by the pool
+    std::vector<Frame*> mvpFree;
+};
+
+#endif // FRAMEPOOL_H
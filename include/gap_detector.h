@@ -0,0 +1,74 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAPDETECTOR_H
+#define GAPDETECTOR_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "occupancy_grid.h"
+
+/**
+ * Gap-filling detection of new keypoints. The image is divided into coarse cells, and each cell is given a quota
+ * of keypoints from its deficit (the share of the cell in the feature number, minus the features already tracked
+ * in it). FAST or Shi-Tomasi is then run only in the cells with a deficit, extended by a margin so that the corners
+ * on the cell borders are found, and the strongest corners inside the cell are kept.
+ * The detection cost scales with the area that needs new features, instead of the whole image. The searched fraction
+ * of the image is recorded in the gap_detector_searched_area_ratio histogram.
+ *
+ *     GapDetector gapDetector(GapDetector::FAST);
+ *     gapDetector.Detect(gray, vTrackedPts, occupancy, nFeatures, nNew, vNewPts);
+ */
+class GapDetector
+{
+public:
+    enum eDetector{
+        FAST = 0,
+        SHI_TOMASI = 1
+    };
+
+    GapDetector(eDetector detector, int cellSize = 60, int margin = 4,
+                int iniThFAST = 20, int minThFAST = 7, float minDistance = 10);
+
+    // Detect at most nNew keypoints out of the occupied cells, for a total of nFeatures with the tracked ones.
+    // The most empty cells are filled first.
+    void Detect(const cv::Mat &gray, const std::vector<cv::KeyPoint> &vTracked, const OccupancyGrid &occupancy,
+                int nFeatures, int nNew, std::vector<cv::Point2f> &vNewPts);
+
+private:
+    void DetectInCell(const cv::Mat &gray, const cv::Rect &cell, const OccupancyGrid &occupancy, int quota,
+                      std::vector<cv::Point2f> &vNewPts);
+
+    eDetector mDetector;
+    int mnCellSize;
+    int mnMargin;
+    int mnIniThFAST, mnMinThFAST;
+    float mfMinDistance;
+
+    // buffers reused by the frames
+    std::vector<int> mvDeficit;             // tracked features, then deficit of each cell
+    std::vector<int> mvCells;               // cells with a deficit, the most empty first
+    std::vector<cv::KeyPoint> mvKeysCell;
+    std::vector<cv::Point2f> mvCornersCell;
+};
+
+#endif // GAPDETECTOR_H
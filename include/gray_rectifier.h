@@ -0,0 +1,50 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GRAYRECTIFIER_H
+#define GRAYRECTIFIER_H
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Rectification of the input images fused with the gray conversion. The rows are processed in bands:
+ * each band is remapped from the color input into a small tile which stays in the cache, and converted to gray
+ * straight into the output, so that the full resolution color image is never rectified nor written back.
+ * The bands are distributed by one cv::parallel_for_, the remap and the conversion of a band are nested in it
+ * and run serially, so the rectification never waits on the shared ThreadPool (it may be called from a worker).
+ *
+ * The maps are the fixed-point maps of CameraParams (CV_16SC2 + CV_16UC1), 6 bytes per pixel instead of 8.
+ */
+class GrayRectifier
+{
+public:
+    // gray is (re)allocated only if its size or type differ, so that the buffer of a recycled frame is reused
+    static void Rectify(const cv::Mat &im, const cv::Mat &map1, const cv::Mat &map2, cv::Mat &gray);
+
+    static const int BAND_ROWS = 16;
+
+private:
+    static void RectifyRows(const cv::Mat &im, const cv::Mat &map1, const cv::Mat &map2, cv::Mat &gray,
+                            int rowBegin, int rowEnd);
+};
+
+#endif // GRAYRECTIFIER_H
@@ -40,6 +40,11 @@
 #include "utils.h"
 #include "imu_types.h"
 #include "frame.h"
+#include "keypoint_grid.h"
+#include "feature_table.h"
+#include "frame_arena.h"
+
+class ResultSink;
 
 using namespace std;
 using namespace cv;
@@ -67,6 +72,12 @@ public:
         SINGLE_HOMOGRAPHY = 2       // the simplified configuration, just used for comparison.
     };
 
+    enum eGeometryValidation{
+        HOMOGRAPHY_OR_FUNDAMENTAL = 0,  // choose H or F (8-point) model by score. Do not need the gyro.
+        GYRO_PRIOR_TWO_POINT = 1        // de-rotate with mRcl and only estimate the translation direction (2-point),
+                                        // fall back to HOMOGRAPHY_OR_FUNDAMENTAL if the gyro prior explains too few tracks
+    };
+
     struct sMatch{
         int queryIdx;   //!< query descriptor index
         int trainIdx;   //!< train descriptor index
@@ -129,14 +140,32 @@ public:
 
     void SetRegularizationPenalty(bool flag) {mbRegularizationPenalty = flag;}
 
-    void SetBackToFrame(Frame& pFrame);
+    // Read-only view of the tracking results, without copying.
+    // Valid while the tracker is alive and until MoveResultsToFrame() is called.
+    struct sResultsView{
+        const std::vector<cv::Point2f> &vPtPredict;
+        const std::vector<cv::Point2f> &vPtPredictUn;
+        const std::vector<cv::Point2f> &vPtGyroPredictUn;
+        const std::vector<uchar> &vStatus;
+        const std::vector<uchar> &vStatusWithoutGeometryValid;  // empty before GeometryValidation()
+        const FeatureTable &features;
+        const cv::Mat &Rcl;
+    };
+    sResultsView GetResults() const;
+
+    // Move the results into the frame in O(1). The tracker must not be used afterwards.
+    void MoveResultsToFrame(Frame& pFrame);
 
     int TrackFeatures();
     int GeometryValidation();
 
     void SetRcl(const cv::Mat Rcl_);
+    // Set the relative rotation integrated in advance (e.g. by IMU::GyroIntegrator),
+    // then TrackFeatures() skips the batch integration of mvImuFromLastFrame.
+    void SetPredictedRcl(const cv::Mat Rcl_);
     cv::Mat GetRcl() {return mRcl.clone();};
     void SetType(eType type_){mType = type_;}
+    void SetGeometryValidation(eGeometryValidation method_){mGeometryValidation = method_;}
 
     // Search matches between keyoints in current frame and reference frame, using gyroscope integration
     // Find minimum distance
@@ -158,10 +187,18 @@ private:
     void IntegrateGyroMeasurements();
     cv::Mat IntegrateOneGyroMeasurement(cv::Point3f &gyro, double dt);
 
-    float CheckHomography(cv::Mat &H21, float &score, std::vector<bool> &vbMatchesInliers, std::vector<cv::Point2f> &vPts1, std::vector<cv::Point2f> &vPts2, float sigma);
-    float CheckFundamental(cv::Mat &F21, float &score, std::vector<bool> &vbMatchesInliers, std::vector<cv::Point2f> &vPts1, std::vector<cv::Point2f> &vPts2, float sigma);
+    // Structure-of-arrays point buffers, scored by CheckHomography() and CheckFundamental()
+    struct sPointsSoA{
+        ArenaVector<float> u1, v1, u2, v2;
+        void Set(const ArenaVector<cv::Point2f> &vPts1, const ArenaVector<cv::Point2f> &vPts2);
+        size_t size() const {return u1.size();}
+    };
 
-    void SaveMsgToFile(std::string filename, std::string &msg);
+    float CheckHomography(cv::Mat &H21, float &score, BitMask &vbMatchesInliers, const cv::Mat &matPts1, const cv::Mat &matPts2, const sPointsSoA &pts, float sigma);
+    float CheckFundamental(cv::Mat &F21, float &score, BitMask &vbMatchesInliers, const cv::Mat &matPts1, const cv::Mat &matPts2, const sPointsSoA &pts, float sigma);
+    // Translation-only model after de-rotating with mRcl (2-point RANSAC), with a pure-rotation test.
+    // Return false if the gyro prior is not consistent with the tracks.
+    bool CheckGyroPriorTranslation(cv::Mat &t21, float &score, BitMask &vbMatchesInliers, const ArenaVector<cv::Point2f> &vPts1, const ArenaVector<cv::Point2f> &vPts2, float sigma);
 
     // Find the nearest and the second nearest ORB features points to the predicted point.
     void FindAndSortNearNeighbor(const cv::Range& range, int level);
@@ -172,8 +209,10 @@ private:
 public:
     eType mType;
     ePredictMethod mPredictMethod;
+    eGeometryValidation mGeometryValidation = HOMOGRAPHY_OR_FUNDAMENTAL;
 
     std::string mSaveFolderPath;
+    ResultSink* mpResultSink;   // sink of mSaveFolderPath, NULL if the results are not saved
 
     double mTimeStamp;
     double mTimeStampRef;
@@ -189,36 +228,26 @@ public:
 
     std::vector<cv::Point2f> mvPtPredict;   // Pixels predicted through gyro integration. (Distorted)
     std::vector<cv::Point2f> mvPtPredictUn; // Pixels predicted through gyro integration. (Undistorted)
-    std::vector<cv::Point2f> mvPtGyroPredict; // Pixels predicted from reference frame. (Distorted)
     std::vector<cv::Point2f> mvPtGyroPredictUn; // Pixels predicted from reference frame. (Undistorted)
 
-    std::vector<std::vector<cv::Point2f>> mvvPtPredictCorners;      // for corners of the predicted pixels. (Distorted)
-    std::vector<std::vector<cv::Point2f>> mvvPtPredictCornersUn;    // for corners of the predicted pixels. (Undistorted)
-    std::vector<std::vector<cv::Point2f>> mvvFlowsPredictCorners;
+    FeatureTable mFeatures;                 // Per-feature tracking state shared with PatchMatch. The vectors above
+                                            // and mvStatus are exported from it for the geometry validation.
 
     std::vector<uchar> mvStatus;            // States. 1: matched; 0: unmatched
+    std::vector<uchar> mvStatusWithoutGeometryValid;    // mvStatus before the outliers are removed by GeometryValidation()
     std::vector<float> mvError;             // Record errors
     std::vector<double> mvDisparities;      // Disparities
     std::vector<sMatch> mvMatches;          // queryIdx: index in reference detected keys;
                                             // trainIdx: index in current detected keys
-    vector<vector<sMatch>> mvvNearNeighbors;     // neighbors of each predicted points
+    vector<vector<sMatch>> mvvNearNeighbors;     // neighbors of each predicted points (the best two)
+    KeyPointGrid mGridCurUn;                     // grid index over mvKeysCurUn
 
     // States for patch matched
     int mHalfPatchSize;
     float mRadiusForFindNearNeighbor;
 
     std::vector<cv::Point2f> mvPatchCorners; // Patch vector of four corners.
-    cv::Mat mMatPatchCorners;   // mMatPatchCorners is used for predicting the affine deformation matrix
-    std::vector<cv::Mat> mvAffineDeformationMatrix; // The affine deformation matrix of predicted by gyro-aided. A = [1 + dxx, dxy; dyx, 1 + dyy]
-
-    std::vector<cv::Point2f> mvPtPredictAfterPatchMatched;   // Pixels predicted by patch match. (Distorted)
-    std::vector<cv::Point2f> mvPtPredictAfterPatchMatchedUn; // Pixels predicted by patch match. (Un-Distorted)
-    std::vector<uchar> mvStatusAfterPatchMatched;            // States. 1: matched; 0: unmatched
-    std::vector<double> mvPixelErrorsOfPatchMatched;
-    std::vector<double> mvDistanceBetweenPredictedAndPatchMatched;
-    std::vector<float> mvNccAfterPatchMatched;
 
-    std::vector<cv::Point2f> mvFlowsPredictUn;  // Flows of gyro. predict
     std::vector<cv::Point2f> mvFlowsErrorUn;  // Flows between the gyro. predict pixel and the detected features
 
     bool mbNCC;  // if true, use ncc to find the nearest matches; else, use distance
@@ -253,6 +282,7 @@ public:
     int mN;
     const cv::Mat &mNormalizeTable;
 
+    bool mbHasPredictedRcl = false;     // true if Rcl is given by SetPredictedRcl()
     bool mbHasGyroPredictInitial = true;
     bool mbConsiderIllumination = true;
     bool mbConsiderAffineDeformation = false;
@@ -26,17 +26,22 @@
 #include <mutex>
 #include <vector>
 #include <utility>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
 #include <eigen3/Eigen/Geometry>
 #include <eigen3/Eigen/Dense>
 
+class TableCache;
+
 class CameraParams{
 public:
     CameraParams(){};
+    // mapCachePath: file caching the rectification maps across the runs, rebuilt if the calibration changed.
+    // Empty: the maps are computed at each start.
     CameraParams(std::string type_, float fx_, float fy_, float cx_, float cy_,
             float k1_, float k2_, float p1_, float p2_, float k3_,
-            int width_, int height_, int fps_) {
+            int width_, int height_, int fps_, const std::string &mapCachePath = "") {
         type = type_;
 
         mK = cv::Mat::eye(3,3,CV_32F);
@@ -56,13 +61,7 @@ public:
         fps = fps_;
         dt = 1.0 / fps;
 
-        // undistort and keep the size. has black region
-        cv::Size imageSize = cv::Size(width, height);
-        double alpha = 0;   // Free scaling parameter between 0 (when all the pixels in the undistorted image are
-                            // valid) and 1 (when all the source image pixels are retained in the undistorted image).
-        cv::initUndistortRectifyMap(mK, mDistCoef, cv::Mat(),
-                                    cv::getOptimalNewCameraMatrix(mK, mDistCoef, imageSize, alpha, imageSize, 0),
-                                    imageSize, CV_32F, M1, M2);
+        InitRectifyMaps(mapCachePath);
     }
 
     void operator=(const CameraParams &s){
@@ -76,6 +75,11 @@ public:
         M2 = s.M2.clone();
     }
 
+private:
+    // Compute M1, M2, or map them from the cache file if it was built with the same calibration
+    void InitRectifyMaps(const std::string &mapCachePath);
+    std::shared_ptr<TableCache> mpMapCache;   // owns the memory of M1, M2 when they are mapped from the cache
+
 public:
     std::string type;
     cv::Mat mK;
@@ -84,7 +88,7 @@ public:
     int height;
     int fps;
     double dt;
-    cv::Mat M1, M2;
+    cv::Mat M1, M2;     // rectification maps: CV_16SC2 integer coordinates, CV_16UC1 interpolation table indices
 };
 
 namespace IMU {
@@ -218,6 +222,58 @@ private:
     std::mutex mMutex;
 };
 
+//Streaming integration of gyro measurements since the last image timestamp.
+//Fed sample by sample (e.g. from the IMU callback), so that the relative rotation
+//is available in O(1) as soon as the next image arrives.
+class GyroIntegrator
+{
+public:
+    GyroIntegrator(const Calib &calib, const cv::Point3f &biasg_ = cv::Point3f(0,0,0), const int &maxStates = 2000);
+    GyroIntegrator() {}
+
+    void SetBias(const cv::Point3f &biasg_);
+
+    // Start a new integration interval at the image timestamp tRef.
+    // Measurements already received after tRef are kept and re-expressed w.r.t. tRef.
+    void Reset(const double &tRef);
+
+    void IntegrateNewMeasurement(const Point &imu);
+
+    // Rotation of the body from tRef to t (boundary interpolated)
+    cv::Mat GetDeltaRotation(const double &t);
+
+    // Relative camera rotation from the reference frame (tRef) to the current frame (t)
+    cv::Mat GetRcl(const double &t);
+
+    int GetMeasurementNumber();
+    bool IsInitialized() {return mbInitialized;}
+
+private:
+    struct state
+    {
+        state(const double &t_, const cv::Point3f &w_, const cv::Mat &R_):t(t_),w(w_),R(R_){}
+        double t;
+        cv::Point3f w;  // raw angular velocity at t
+        cv::Mat R;      // rotation from tRef to t
+    };
+
+    cv::Mat DeltaRotation(const double &t, cv::Point3f &w) const;
+    cv::Mat IntegrateOneStep(const cv::Mat &R, const cv::Point3f &angVel, const double &dt) const;
+
+    cv::Mat mRbc;
+    cv::Point3f mBiasg;
+    int mnMaxStates;
+
+    bool mbInitialized = false;
+    double mtRef;
+    bool mbHasLast = false;     // last measurement received before tRef, used to interpolate at tRef
+    double mtLast;
+    cv::Point3f mwLast;
+
+    std::vector<state> mvStates;  // mvStates[0] is anchored at tRef
+    std::mutex mMutex;
+};
+
 
 // Lie Algebra Functions
 cv::Mat ExpSO3(const float &x, const float &y, const float &z);
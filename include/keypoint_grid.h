@@ -0,0 +1,61 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef KEYPOINTGRID_H
+#define KEYPOINTGRID_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Uniform grid index over the keypoints of one frame, used to find the keypoints near a predicted point.
+ * The cells are stored contiguously (counting sort), i.e., the indices of cell c are
+ * mvIndices[mvCellStart[c]] ... mvIndices[mvCellStart[c+1]-1].
+ */
+class KeyPointGrid
+{
+public:
+    KeyPointGrid(){}
+
+    void Build(const std::vector<cv::KeyPoint> &vKeys, int width, int height, float cellSize);
+    void Build(const std::vector<cv::Point2f> &vPts, int width, int height, float cellSize);
+
+    // Get the indices of the points inside the square window [x - r, x + r] x [y - r, y + r]
+    void GetFeaturesInArea(const cv::Point2f &pt, float r, std::vector<int> &vIndices) const;
+
+    const cv::Point2f& GetPoint(int idx) const {return mvPts[idx];}
+    bool Empty() const {return mvPts.empty();}
+
+private:
+    void Build(int width, int height, float cellSize);
+    inline int CellCol(float x) const;
+    inline int CellRow(float y) const;
+
+    float mfCellSizeInv;
+    int mnCols, mnRows;
+    std::vector<cv::Point2f> mvPts;
+    std::vector<int> mvCellStart;
+    std::vector<int> mvIndices;
+};
+
+#endif // KEYPOINTGRID_H
@@ -0,0 +1,96 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KEYPOINTSTORE_H
+#define KEYPOINTSTORE_H
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Read-only, memory-mapped container of the keypoints detected by an external detector (e.g. SuperPoint)
+ * for all the frames of a sequence. The frames are sorted by timestamp, so a frame is found by binary search
+ * and its keypoints are returned in place, without parsing nor copying.
+ *
+ * Binary layout (host endianness):
+ *     sHeader
+ *     sFrameEntry[nFrames]     sorted by t
+ *     float[2 * nPoints]       x, y of the keypoints of all the frames
+ *
+ * Convert() builds the file from the text format: <folder>/corresponds.txt ("timestamp, name" per line)
+ * and one <folder>/<name>.txt per frame ("index, x, y, ..." per keypoint). The header keeps a fingerprint
+ * of corresponds.txt (size and modification time), the store is rebuilt when it changes. The check is O(1),
+ * the frame files are not visited: after editing them in place, touch corresponds.txt or remove the store.
+ */
+class KeypointStore
+{
+public:
+    struct sHeader{
+        char magic[8];      // "KPSTORE"
+        uint32_t version;
+        uint32_t nFrames;
+        uint64_t nPoints;
+        uint64_t nSource;   // Fingerprint() of the text files the store was converted from
+    };
+
+    struct sFrameEntry{
+        double t;
+        uint64_t nFirst;    // index of the first keypoint of the frame
+        uint32_t n;
+        uint32_t reserved;
+    };
+
+    KeypointStore();
+    ~KeypointStore();
+
+    // folder: the text files of the store, fail if they changed since Convert(). Empty: no check.
+    bool Open(const std::string &path, const std::string &folder = std::string());
+    void Close();
+    bool IsOpen() const {return mpData != NULL;}
+
+    // Index of the frame at time t (|t - t_frame| < eps), -1 if there is none
+    int Find(double t, double eps = 1e-4) const;
+
+    int GetFrameNumber() const {return mpHeader? int(mpHeader->nFrames): 0;}
+    double GetTimeStamp(int idx) const {return mpFrames[idx].t;}
+    int GetKeypointNumber(int idx) const {return mpFrames[idx].n;}
+    const cv::Point2f* GetKeypoints(int idx) const {return mpPoints + mpFrames[idx].nFirst;}
+
+    static bool Convert(const std::string &folder, const std::string &path);
+
+    // Hash of the size and the modification time of <folder>/corresponds.txt
+    static uint64_t Fingerprint(const std::string &folder);
+
+private:
+    KeypointStore(const KeypointStore&);
+    KeypointStore& operator=(const KeypointStore&);
+
+    void* mpData;
+    size_t mnSize;
+    const sHeader* mpHeader;
+    const sFrameEntry* mpFrames;
+    const cv::Point2f* mpPoints;
+};
+
+#endif // KEYPOINTSTORE_H
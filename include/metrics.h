@@ -0,0 +1,152 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+/**
+ * Monotonic counter, updated lock-free
+ */
+class Counter
+{
+public:
+    Counter(const std::string &name, const std::string &help): mName(name), mHelp(help), mnValue(0) {}
+
+    inline void Add(uint64_t n = 1) {mnValue.fetch_add(n, std::memory_order_relaxed);}
+    uint64_t Value() const {return mnValue.load(std::memory_order_relaxed);}
+
+    const std::string mName;
+    const std::string mHelp;
+
+private:
+    std::atomic<uint64_t> mnValue;
+};
+
+/**
+ * Fixed-bucket histogram with HDR-style log-linear buckets, updated lock-free.
+ * The values are scaled to integers (e.g., scale = 1e6 records seconds with microsecond resolution),
+ * every power of two is split into 16 linear sub-buckets, so the relative error of the quantiles is below 1/16.
+ */
+class Histogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    Histogram(const std::string &name, const std::string &help, double scale);
+
+    void Record(double value);
+
+    // Quantile q in [0,1], in the unit of the recorded values
+    double Quantile(double q) const;
+    uint64_t Count() const {return mnCount.load(std::memory_order_relaxed);}
+    double Sum() const {return mnSum.load(std::memory_order_relaxed) / mScale;}
+    double Max() const {return mnMax.load(std::memory_order_relaxed) / mScale;}
+
+    const std::string mName;
+    const std::string mHelp;
+
+private:
+    static int BucketIndex(uint64_t v);
+    static uint64_t BucketLowerBound(int idx);
+
+    const double mScale;
+    std::atomic<uint64_t> mvBuckets[BUCKETS];
+    std::atomic<uint64_t> mnCount;
+    std::atomic<uint64_t> mnSum;
+    std::atomic<uint64_t> mnMax;
+};
+
+struct sMetricsSnapshot
+{
+    struct sCounter{
+        std::string name, help;
+        uint64_t value;
+    };
+    struct sHistogram{
+        std::string name, help;
+        uint64_t count;
+        double sum, max;
+        double p50, p90, p99, p999;
+    };
+
+    double t;   // unix time of the snapshot
+    std::vector<sCounter> vCounters;
+    std::vector<sHistogram> vHistograms;
+
+    // Prometheus text exposition format. The histograms are exported as summaries (quantiles, _sum and _count).
+    std::string ToPrometheusText() const;
+};
+
+/**
+ * Process wide registry of the counters and histograms.
+ * Registration takes a lock, so cache the returned pointer (e.g., in a function-local static);
+ * the updates afterward are lock-free and can be done from any thread.
+ */
+class MetricsRegistry
+{
+public:
+    static MetricsRegistry* GetInstance();
+
+    // Return the existing metric if the name is already registered
+    Counter* GetCounter(const std::string &name, const std::string &help);
+    Histogram* GetHistogram(const std::string &name, const std::string &help, double scale);
+
+    sMetricsSnapshot Snapshot();
+
+    // Write the snapshot to the file every period seconds (written to a temporary file and renamed,
+    // e.g., for the textfile collector of node_exporter). The last snapshot is written when stopped.
+    void StartPeriodicDump(const std::string &filename, double period);
+    void StopPeriodicDump();
+    bool Dump(const std::string &filename);
+
+    ~MetricsRegistry();
+
+private:
+    MetricsRegistry() : mbStop(false) {}
+    MetricsRegistry(const MetricsRegistry&);
+    MetricsRegistry& operator=(const MetricsRegistry&);
+
+    void RunDump(std::string filename, double period);
+
+    std::mutex mMutex;
+    std::map<std::string, std::unique_ptr<Counter> > mmCounters;
+    std::map<std::string, std::unique_ptr<Histogram> > mmHistograms;
+
+    std::mutex mMutexDump;
+    std::condition_variable mConditionDump;
+    bool mbStop;
+    std::thread mThreadDump;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,77 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCCUPANCYGRID_H
+#define OCCUPANCYGRID_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Coarse occupancy of the image by the tracked features, one byte per cell instead of a full-resolution mask.
+ * The detector skips the regions whose cells are all occupied and rejects the keypoints in occupied cells.
+ * GetMask() materializes the equivalent full-resolution mask (1: free, 0: occupied), only for debugging.
+ */
+class OccupancyGrid
+{
+public:
+    OccupancyGrid(): mnCellSize(1), mfCellSizeInv(1.0f), mnCols(0), mnRows(0), mnWidth(0), mnHeight(0) {}
+
+    // Resize to the image and mark all the cells free. The buffer is reused.
+    void Reset(int width, int height, int cellSize);
+
+    // Mark the cells whose center is inside the square [x - r, x + r) x [y - r, y + r),
+    // at least the cell containing pt.
+    void Mark(const cv::Point2f &pt, float r);
+
+    bool IsOccupied(const cv::Point2f &pt) const {return !mvCells.empty() && mvCells[CellRow(pt.y) * mnCols + CellCol(pt.x)] != 0;}
+
+    // True if all the cells overlapping the rectangle [x0, x1) x [y0, y1) are occupied
+    bool IsRegionOccupied(float x0, float y0, float x1, float y1) const;
+
+    cv::Mat GetMask() const;
+
+    int GetCellSize() const {return mnCellSize;}
+    bool Empty() const {return mvCells.empty();}
+
+private:
+    int CellCol(float x) const
+    {
+        int c = int(std::floor(x * mfCellSizeInv));
+        return std::min(std::max(c, 0), mnCols - 1);
+    }
+    int CellRow(float y) const
+    {
+        int r = int(std::floor(y * mfCellSizeInv));
+        return std::min(std::max(r, 0), mnRows - 1);
+    }
+
+    int mnCellSize;
+    float mfCellSizeInv;
+    int mnCols, mnRows;
+    int mnWidth, mnHeight;
+    std::vector<uchar> mvCells;     // row major, 1: occupied
+};
+
+#endif // OCCUPANCYGRID_H
@@ -33,6 +33,8 @@
 #include <chrono>
 #include <functional>
 
+#include "feature_table.h"
+
 using namespace std;
 using namespace cv;
 
@@ -58,18 +60,17 @@ public:
                                                            const bool bConsiderIllumination,
                                                            const bool bConsiderAffineDeformation,
                                                            const bool bRegularizationPenalty);
-    void SetMatcher();
-
     // Get a gray scale value from reference image (bi-linear interpolated)
     inline float GetPixelValue(const cv::Mat &img, float x, float y) const;
 
     void DistortPoints();
 
     // Zero-Normalized cross correlation
-    float NCC(int halfPathSize, const cv::Mat &ref, const cv::Mat &cur, const cv::Point2f &pt_ref, const cv::Point2f &pt_cur, const cv::Mat &warp_mat);
+    float NCC(int halfPathSize, const cv::Mat &ref, const cv::Mat &cur, const cv::Point2f &pt_ref, const cv::Point2f &pt_cur, const cv::Matx22f &warp_mat);
 
 private:
     GyroAidedTracker* mpMatcher;
+    FeatureTable &mFeatures;    // reads the predicted pixels and affine matrices, writes the matched pixels, errors and ncc
     int mN;
     int mHalfPatchSize;
     int mIterations;
@@ -93,13 +94,7 @@ private:
     float mInvLogMaxDist;
 
     std::vector<float> mvScales;
-    std::vector<bool> mvSuccess;
-    std::vector<double> mvPixelErrorsOfPatchMatched;    // pixel errors of patched matched
-    std::vector<float> mvNcc;
-
-    std::vector<uchar> mvGyroPredictStatus;
     std::vector<cv::Mat> mvImgPyr1, mvImgPyr2;          // image pyramids
-    std::vector<cv::Point2f> mvPtPyr1Un, mvPtPyr2, mvPtPyr2Un;
 };
 
 
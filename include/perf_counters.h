@@ -0,0 +1,115 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+/**
+ * Hardware performance counters (cycles, instructions, LLC misses, branch misses) per pipeline stage,
+ * read from a Linux perf_event_open group at the stage boundaries.
+ *
+ *     cv::parallel_for_(range, [&](const cv::Range& r){
+ *         PERF_SCOPE("klt");              // counted on each worker thread that runs a part of the stage
+ *         ...
+ *     });
+ *     PERF_END_FRAME();                   // per-frame IPC and miss rates to the metrics registry
+ *     PERF_REPORT();                      // aggregate IPC and miss rates to the log
+ *
+ * The counters only count the thread that opened them, so put the scopes in the code executed by the workers.
+ * If the counters can not be opened (e.g., /proc/sys/kernel/perf_event_paranoid forbids it, or no PMU in a VM)
+ * a warning is logged once and the scopes do nothing.
+ * Compiled out unless ENABLE_PERF_COUNTERS is defined (cmake -DENABLE_PERF_COUNTERS=ON), Linux only.
+ */
+
+#if defined(ENABLE_PERF_COUNTERS) && defined(__linux__)
+
+#include <stdint.h>
+
+class PerfCounters
+{
+public:
+    enum eEvent{
+        CYCLES = 0,
+        INSTRUCTIONS = 1,
+        LLC_MISSES = 2,
+        BRANCH_MISSES = 3,
+        EVENT_NUM = 4
+    };
+
+    struct sValues{
+        uint64_t v[EVENT_NUM];
+    };
+
+    static const int MAX_STAGES = 32;
+
+    // Return the stage id, or -1 if there are too many stages. The name must be a string literal.
+    static int RegisterStage(const char* name);
+
+    // Read the counters of the calling thread (scaled if multiplexed). Return false if they are not available.
+    static bool Read(sValues &values);
+
+    static void Accumulate(int stage, const sValues &begin, const sValues &end);
+
+    // Push the counters of the current frame to the metrics registry and start a new frame
+    static void EndFrame();
+
+    // Log the aggregate IPC and miss rates of each stage
+    static void Report();
+};
+
+class PerfScope
+{
+public:
+    explicit PerfScope(int stage): mStage(stage) {mbValid = mStage >= 0 && PerfCounters::Read(mBegin);}
+    ~PerfScope()
+    {
+        PerfCounters::sValues end;
+        if(mbValid && PerfCounters::Read(end))
+            PerfCounters::Accumulate(mStage, mBegin, end);
+    }
+
+private:
+    PerfScope(const PerfScope&);
+    PerfScope& operator=(const PerfScope&);
+
+    int mStage;
+    bool mbValid;
+    PerfCounters::sValues mBegin;
+};
+
+#define PERF_CONCAT_IMPL(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_IMPL(a, b)
+#define PERF_SCOPE(name) \
+    static const int PERF_CONCAT(perfStage_, __LINE__) = PerfCounters::RegisterStage(name); \
+    PerfScope PERF_CONCAT(perfScope_, __LINE__)(PERF_CONCAT(perfStage_, __LINE__))
+#define PERF_END_FRAME() PerfCounters::EndFrame()
+#define PERF_REPORT() PerfCounters::Report()
+
+#else
+
+#define PERF_SCOPE(name) ((void)0)
+#define PERF_END_FRAME() ((void)0)
+#define PERF_REPORT() ((void)0)
+
+#endif
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,110 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESULTSINK_H
+#define RESULTSINK_H
+
+#include <string>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <stdint.h>
+
+#include "bounded_queue.h"
+
+/**
+ * Session wide output of the per-frame results and statistics.
+ * The tracking thread only pushes fixed size records into a bounded lock-free queue,
+ * a background thread formats them (CSV, or compact binary) and writes them to the save folder.
+ * If the disk stalls and the queue is full, the record is dropped and counted instead of blocking the tracking.
+ * The writer sleeps on a condition variable when the queue is empty, Push() only takes the lock to wake it up.
+ * Resolve the sink once (e.g. in the constructor of the caller) and push to the pointer.
+ */
+class ResultSink
+{
+public:
+    enum eFormat{
+        CSV = 0,
+        BINARY = 1
+    };
+
+    // One output file per record type
+    enum eRecordType{
+        TRACK_FEATURES = 0,     // trackFeatures: statistics of GyroAidedTracker::GeometryValidation
+        TIME_COST = 1,          // timeCost: time cost of the GyroAidedTracker stages
+        ORB_MATCH = 2,          // ORBDetectAndDespMatch: statistics of ORBDetectAndDespMatcher
+        RECORD_TYPE_NUM = 3
+    };
+
+    static const int MAX_VALUES = 8;
+
+    // Binary layout of one record, the .bin files are a sequence of this struct (48 bytes)
+    struct sRecord{
+        double t;
+        int32_t type;
+        int32_t n;
+        float values[MAX_VALUES];
+    };
+
+    ResultSink(const std::string &saveFolderPath, eFormat format = CSV, size_t capacity = 4096);
+    ~ResultSink();
+
+    // Non-blocking. Return false if the record is dropped.
+    bool Push(eRecordType type, double t, const float *values, int n);
+
+    uint64_t GetDroppedNumber() const {return mnDropped.load();}
+    const std::string& GetSaveFolderPath() const {return mSaveFolderPath;}
+
+    // Create the sink of the folder once per session. Return the existing one if it is already created.
+    static ResultSink* Create(const std::string &saveFolderPath, eFormat format = CSV);
+    // Return the sink of the folder (created with the CSV format if needed), or NULL if the path is empty.
+    // The last sink is cached per thread, the lock is only taken when the folder changes.
+    static ResultSink* Get(const std::string &saveFolderPath);
+
+private:
+    ResultSink(const ResultSink&);
+    ResultSink& operator=(const ResultSink&);
+
+    void Run();
+    void Write(const sRecord &record);
+
+    std::string mSaveFolderPath;
+    eFormat mFormat;
+    std::ofstream mvFiles[RECORD_TYPE_NUM];
+
+    BoundedQueue<sRecord> mQueue;
+    std::atomic<uint64_t> mnDropped;
+    std::atomic<bool> mbStop;
+    std::atomic<bool> mbWaiting;    // the writer sleeps (or is about to) on mCondition
+    std::mutex mMutexWait;
+    std::condition_variable mCondition;
+    std::thread mThread;
+
+    static std::mutex mMutexSinks;
+    static std::map<std::string, std::unique_ptr<ResultSink> > mmSinks;   // flushed and joined at exit
+};
+
+#endif // RESULTSINK_H
@@ -0,0 +1,37 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STAGESCOPE_H
+#define STAGESCOPE_H
+
+#include "perf_counters.h"
+#include "alloc_tracker.h"
+
+/**
+ * Instrumentation of one pipeline stage: hardware performance counters (perf_counters.h)
+ * and heap allocation accounting (alloc_tracker.h). Each of them is compiled out unless enabled.
+ */
+#define STAGE_SCOPE(name) PERF_SCOPE(name); ALLOC_SCOPE(name)
+#define STAGE_END_FRAME() do{PERF_END_FRAME(); ALLOC_END_FRAME();}while(0)
+#define STAGE_REPORT() do{PERF_REPORT(); ALLOC_REPORT();}while(0)
+
+#endif // STAGESCOPE_H
@@ -0,0 +1,95 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TABLECACHE_H
+#define TABLECACHE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include <opencv2/core/core.hpp>
+
+/**
+ * On-disk cache of lookup tables which are slow to build at startup (e.g. the rectification maps of
+ * CameraParams). The file is keyed by a hash of everything the tables are computed from (calibration,
+ * resolution, ...). Open() memory-maps it and fails if the hash differs, then the caller rebuilds
+ * the tables and Save() replaces the file.
+ *
+ *     TableCache cache;
+ *     if(!cache.Open(path, hash)){
+ *         ...build vTables...
+ *         TableCache::Save(path, hash, vTables);
+ *     }
+ *     cv::Mat table = cache.GetTable(0);    // read-only, valid while the cache is alive
+ *
+ * Binary layout (host endianness):
+ *     sHeader
+ *     sTable[nTables]
+ *     data of the tables, each one 64-byte aligned
+ */
+class TableCache
+{
+public:
+    struct sHeader{
+        char magic[8];      // "TBCACHE"
+        uint32_t version;
+        uint32_t nTables;
+        uint64_t hash;
+    };
+
+    struct sTable{
+        int32_t rows;
+        int32_t cols;
+        int32_t type;
+        uint32_t reserved;
+        uint64_t offset;    // from the beginning of the file
+    };
+
+    TableCache();
+    ~TableCache();
+
+    bool Open(const std::string &path, uint64_t hash);
+    void Close();
+    bool IsOpen() const {return mpData != NULL;}
+
+    int GetTableNumber() const {return mpHeader? int(mpHeader->nTables): 0;}
+
+    // Header over the mapped data, without copy. The data is read-only.
+    cv::Mat GetTable(int idx) const;
+
+    static bool Save(const std::string &path, uint64_t hash, const std::vector<cv::Mat> &vTables);
+
+    // FNV-1a, chained through seed
+    static uint64_t Hash(const void* pData, size_t n, uint64_t seed = 14695981039346656037ULL);
+
+private:
+    TableCache(const TableCache&);
+    TableCache& operator=(const TableCache&);
+
+    void* mpData;
+    size_t mnSize;
+    const sHeader* mpHeader;
+    const sTable* mpTables;
+};
+
+#endif // TABLECACHE_H
@@ -0,0 +1,72 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+/**
+ * A persistent pool of worker threads. The tasks are executed in FIFO order.
+ * Used to avoid spawning new std::thread for each frame.
+ * A task enqueued from a worker of the same pool runs inline: a worker waiting on the future of a nested
+ * task could otherwise deadlock the pool when all the workers wait (e.g. several streams sharing it).
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int nThreads);
+    ~ThreadPool();
+
+    // Push a task to the queue, the returned future is ready when the task is finished.
+    // Called from a worker of this pool, the task is executed before returning.
+    std::future<void> Enqueue(const std::function<void()> &task);
+
+    // Whether the calling thread is a worker of this pool
+    bool IsWorkerThread() const;
+
+    int GetThreadNumber() const {return mvWorkers.size();}
+
+    // The process wide pool shared by all the trackers
+    static ThreadPool* GetInstance();
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void Run();
+
+    std::vector<std::thread> mvWorkers;
+    std::queue<std::packaged_task<void()> > mqTasks;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mbStop;
+};
+
+#endif // THREADPOOL_H
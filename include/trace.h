@@ -0,0 +1,93 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Scoped tracing spans, exported as Chrome trace-event JSON (open with chrome://tracing or ui.perfetto.dev).
+ *
+ *     void Foo() {
+ *         TRACE_SCOPE("Foo");                  // span from here to the end of the scope
+ *         for (int level = 0; level < n; level++) {
+ *             TRACE_SCOPE_ARG("FooLevel", level);
+ *             ...
+ *         }
+ *     }
+ *     TRACE_EXPORT(saveFolderPath + "trace.json");
+ *
+ * The span names must be string literals. Each thread records into its own buffer.
+ * Compiled out entirely unless ENABLE_TRACING is defined (cmake -DENABLE_TRACING=ON).
+ */
+
+#ifdef ENABLE_TRACING
+
+#include <string>
+#include <stdint.h>
+#include <chrono>
+
+class Tracer
+{
+public:
+    static inline int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Append a complete event to the buffer of the calling thread
+    static void Record(const char* name, int64_t tBegin, int64_t tEnd, int arg);
+
+    // Write all the recorded events. Call it when the traced threads are idle, e.g., at the end of the session.
+    static bool Export(const std::string &filename);
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name, int arg = -1): mName(name), mArg(arg), mtBegin(Tracer::Now()) {}
+    ~TraceSpan() {Tracer::Record(mName, mtBegin, Tracer::Now(), mArg);}
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    const char* mName;
+    int mArg;
+    int64_t mtBegin;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(name, arg)
+#define TRACE_EXPORT(filename) Tracer::Export(filename)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, arg) ((void)0)
+#define TRACE_EXPORT(filename) ((void)0)
+
+#endif // ENABLE_TRACING
+
+#endif // TRACE_H
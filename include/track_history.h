@@ -0,0 +1,79 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKHISTORY_H
+#define TRACKHISTORY_H
+
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+
+class Frame;
+
+/**
+ * Bounded history of the alive tracks, for the consumers that need the past observations of a track
+ * without chaining Frame::mvPtIndexInLastFrame back through the old frames.
+ * Each track owns a slot with a ring of the last nDepth samples. All the rings are stored contiguously
+ * (slot-major), and the slot of a track is recycled when the track is lost.
+ *
+ *     trackHistory.Update(curFrame);   // once per frame, after the new keypoints are detected
+ *     trackHistory.GetHistory(curFrame.mvTrackIds[i], vSamples);
+ */
+class TrackHistory
+{
+public:
+    struct sSample{
+        cv::Point2f pt;     // undistorted position
+        double t;           // timestamp of the frame
+        float ncc;          // zero-normalized cross correlation with the last frame, 1 at detection
+    };
+
+    explicit TrackHistory(int nDepth, int nReserveTracks = 512);
+
+    // Append the observations of the frame, and release the tracks which are not in the frame
+    void Update(const Frame &frame);
+
+    // Samples of the track from the oldest to the newest. Return false if the track is not alive.
+    bool GetHistory(uint64_t nTrackId, std::vector<sSample> &vSamples) const;
+
+    // Number of samples of the track (at most the depth), 0 if the track is not alive
+    int GetLength(uint64_t nTrackId) const;
+
+    int GetDepth() const {return mnDepth;}
+    size_t GetTrackNumber() const {return mmSlots.size();}
+
+private:
+    int AcquireSlot(uint64_t nTrackId);
+
+    int mnDepth;
+    std::vector<sSample> mvSamples;     // mnDepth samples per slot
+    std::vector<int> mvHead;            // index of the next sample in the ring of the slot
+    std::vector<int> mvLength;
+    std::vector<uint64_t> mvSlotTrackId;
+    std::vector<unsigned int> mvSlotStamp;  // last update in which the slot was seen
+    std::vector<int> mvFreeSlots;
+    std::unordered_map<uint64_t, int> mmSlots;  // track id -> slot
+    unsigned int mnStamp;
+};
+
+#endif // TRACKHISTORY_H
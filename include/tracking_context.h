@@ -0,0 +1,69 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKINGCONTEXT_H
+#define TRACKINGCONTEXT_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * State of one tracked image stream, shared by all the frames of the stream: the frame and track id
+ * generators and the detection state carried from frame to frame. Each stream owns its context, so that
+ * several independent trackers (e.g. one per camera) can run in one process, on a shared thread pool.
+ *
+ *     TrackingContext context;
+ *     pCurFrame->Init(t, im, im_dist, pLastFrame, ..., &context);
+ *
+ * The ids are drawn atomically, so that the frames of a stream may be processed by any thread.
+ * The other members belong to the stream and must only be used by one frame at a time.
+ * Each stream calls FrameArena::EndFrame() on its own tracking thread, which resets only the arena of that
+ * thread. A task enqueued from a worker of the shared ThreadPool runs inline, so no worker blocks on the pool.
+ */
+class TrackingContext
+{
+public:
+    TrackingContext();
+
+    long unsigned int NewFrameId() {return mnNextFrameId.fetch_add(1, std::memory_order_relaxed);}
+
+    // Reserve n consecutive track ids, return the first one
+    uint64_t NewTrackIds(size_t n = 1) {return mnNextTrackId.fetch_add(n, std::memory_order_relaxed);}
+
+    // Context of the frames initialized without one (single stream applications)
+    static TrackingContext* GetDefault();
+
+public:
+    bool mbReachMaxFeature;     // the last detection reached the keypoint number, ensure to detect max feature
+    bool mbRetainDistortedImage;    // keep a handle to the raw input in Frame::mGrayDistort. Set it only
+                                    // when a consumer of the distorted images is attached
+
+private:
+    TrackingContext(const TrackingContext&);
+    TrackingContext& operator=(const TrackingContext&);
+
+    std::atomic<long unsigned int> mnNextFrameId;
+    std::atomic<uint64_t> mnNextTrackId;
+};
+
+#endif // TRACKINGCONTEXT_H
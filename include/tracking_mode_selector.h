@@ -0,0 +1,78 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACKINGMODESELECTOR_H
+#define TRACKINGMODESELECTOR_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "imu_types.h"
+#include "gyro_aided_tracker.h"
+
+/**
+ * Per-frame selection of the cheapest tracking model (GyroAidedTracker::eType) that is adequate for the motion.
+ * The modes are ordered by cost:
+ *     GYRO_PREDICT < GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED < ..._CONSIDER_ILLUMINATION < maxType
+ * Only the levels cheaper than maxType are used. maxType must be gyro-aided, the image-only modes fall back
+ * to the default.
+ * The level is chosen from the integrated rotation angle, the peak angular rate and the recent failure rate
+ * (tracks lost by the last frames). It goes up at once, but only goes down one level after the lower level
+ * has been adequate, with tighter thresholds, for several consecutive frames (hysteresis).
+ *
+ * The failures are measured the same way in all the modes: the lost tracks, plus the tracks whose patches
+ * do not correlate (NCC on a sample). The inliers alone can not see the failures of GYRO_PREDICT, whose
+ * predictions are consistent with the rotation by construction and pass the geometry validation.
+ *
+ *     type = selector.Select(Rcl, vImuMeas, biasg, dt);     // before tracking
+ *     ...
+ *     selector.Update(tracker, nTracked);                   // after GeometryValidation()
+ */
+class TrackingModeSelector
+{
+public:
+    TrackingModeSelector(GyroAidedTracker::eType maxType =
+            GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION);
+
+    // Select the mode of the current frame. Rcl: rotation from the last frame, dt: time between the frames.
+    GyroAidedTracker::eType Select(const cv::Mat &Rcl, const std::vector<IMU::Point> &vImu,
+                                   const cv::Point3f &biasg, double dt);
+
+    // Feed back the tracking result of the frame, before the results are moved out of the tracker
+    void Update(const GyroAidedTracker &tracker, int nTracked);
+
+    GyroAidedTracker::eType GetType() const {return mvLadder[mnLevel];}
+    float GetFailureRate() const {return mfFailureRate;}
+
+    static const char* GetName(GyroAidedTracker::eType type);
+
+private:
+    // Cheapest level adequate for the motion. scale < 1 tightens the thresholds (used to go down).
+    int RequiredLevel(float angle, float rate, float scale) const;
+
+    std::vector<GyroAidedTracker::eType> mvLadder;
+    int mnLevel;            // index in mvLadder of the current mode
+    int mnDownFrames;       // consecutive frames on which a lower level was adequate
+    float mfFailureRate;    // exponential moving average of the ratio of lost or dissimilar tracks
+};
+
+#endif // TRACKINGMODESELECTOR_H
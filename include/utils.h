@@ -25,6 +25,8 @@
 
 #include "iostream"
 #include "vector"
+#include <algorithm>
+#include <stdint.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
 
@@ -56,6 +58,35 @@ float NCC(int halfPathSize, std::vector<float> &vValuesRef, const float mean_ref
 // Zero-Normalized cross correlation
 float NCC(int halfPathSize, const cv::Mat &ref, const cv::Mat &cur, const cv::Point2f &pt_ref, const cv::Point2f &pt_cur, const cv::Mat &warp_mat);
 
+// Dynamic-size bitset, 64 flags per word. e.g., the inlier masks of geometry validation
+class BitMask
+{
+public:
+    BitMask(size_t n = 0) {Resize(n);}
+
+    // Resize and clear all the bits
+    void Resize(size_t n) {mN = n; mvWords.assign((n + 63) >> 6, 0);}
+    void Clear() {std::fill(mvWords.begin(), mvWords.end(), 0);}
+
+    inline void Set(size_t i) {mvWords[i >> 6] |= (uint64_t(1) << (i & 63));}
+    inline void Reset(size_t i) {mvWords[i >> 6] &= ~(uint64_t(1) << (i & 63));}
+    inline bool Test(size_t i) const {return (mvWords[i >> 6] >> (i & 63)) & 1;}
+
+    size_t Count() const {
+        size_t n = 0;
+        for (size_t k = 0; k < mvWords.size(); k++)
+            n += __builtin_popcountll(mvWords[k]);
+        return n;
+    }
+
+    size_t size() const {return mN;}
+    void swap(BitMask &m) {std::swap(mN, m.mN); mvWords.swap(m.mvWords);}
+
+private:
+    size_t mN;
+    std::vector<uint64_t> mvWords;
+};
+
 //the following are UBUNTU/LINUX ONLY terminal color
 #define RESET "\033[0m"
 #define BLACK "\033[30m" /* Black */
@@ -0,0 +1,137 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio/videoio.hpp>
+
+class Frame;
+
+/**
+ * Visualization of the tracking results on a background thread.
+ * The tracking thread only copies a snapshot of the data drawn (the two gray images and the tracked points,
+ * not the whole Frame) into a free buffer. The viewer thread draws the latest snapshot and shows it in a window,
+ * or encodes it to a video file or an image sequence (headless, e.g. on CI machines).
+ * The snapshots are triple buffered: if the viewer is behind, the stale snapshot is replaced by the new one
+ * and counted as dropped, so that the tracking never waits for the GUI nor the encoder.
+ *
+ *     Viewer viewer(Viewer::WINDOW, "Tracking");
+ *     viewer.Push(curFrame, options);   // once per frame, after the tracking
+ *     if(viewer.GetKey() == 's') ...    // key pressed in the window
+ */
+class Viewer
+{
+public:
+    enum eMode{
+        NONE = 0,       // no visualization
+        WINDOW = 1,     // cv::imshow
+        VIDEO = 2,      // video file (MJPG)
+        IMAGES = 3      // one png per frame, named by the frame id
+    };
+
+    struct sOptions{
+        sOptions(): drawFlowType(0), bDrawPatch(true), bDrawMistracks(true), bDrawGyroPredictPosition(true) {}
+        int drawFlowType;   // 0: draw flows on the current frame; 1: draw match line across two frames
+        bool bDrawPatch;
+        bool bDrawMistracks;
+        bool bDrawGyroPredictPosition;
+    };
+
+    // Patch of a track which is predicted and kept by the geometry validation
+    struct sPatch{
+        cv::Point2f ptCur;      // undistorted position in the current frame
+        cv::Point2f ptRef;      // undistorted position in the last frame
+        cv::Point2f corners[4]; // tl, tr, bl, br, relative to ptCur
+    };
+
+    // Everything drawn for one frame, indexed by the keypoints of the last frame
+    struct sSnapshot{
+        long unsigned int nId;
+        double t;
+        cv::Mat grayLast, gray;
+        std::vector<cv::Point2f> vPtRef;    // keypoints of the last frame
+        std::vector<cv::Point2f> vPtCur;    // predicted and matched positions in the current frame
+        std::vector<cv::Point2f> vPtGyro;   // gyro predicted positions, empty for image-only tracking
+        std::vector<uchar> vStatus;         // tracked, before geometry validation
+        std::vector<uchar> vGood;           // kept by geometry validation
+        std::vector<sPatch> vPatches;
+        int nLastKeys;
+        int nRefKeys;
+        sOptions options;
+    };
+
+    // output: video file (VIDEO) or folder (IMAGES)
+    Viewer(eMode mode, const std::string &winname, const std::string &output = "", double fps = 30);
+    ~Viewer();
+
+    // Non-blocking. Copy the data drawn for the frame, and replace the snapshot not yet drawn if any.
+    void Push(const Frame &frame, const sOptions &options);
+
+    // Last key pressed in the window (WINDOW mode), -1 if none. The key is consumed.
+    int GetKey() {return mnKey.exchange(-1);}
+
+    eMode GetMode() const {return mMode;}
+    uint64_t GetDroppedNumber() const {return mnDropped.load();}
+
+    // Synchronous path, used by Frame::Display()
+    static void TakeSnapshot(const Frame &frame, const sOptions &options, sSnapshot &snapshot);
+    static void Draw(const sSnapshot &snapshot, cv::Mat &im);
+
+private:
+    Viewer(const Viewer&);
+    Viewer& operator=(const Viewer&);
+
+    void Run();
+    void Output(const sSnapshot &snapshot);
+
+    eMode mMode;
+    std::string mWinname;
+    std::string mOutput;
+    double mfFps;
+    cv::VideoWriter mVideoWriter;   // opened with the size of the first image
+    bool mbVideoFailed;
+    cv::Mat mImage;
+
+    // Triple buffering: the tracking thread fills mnWrite, the viewer thread draws mnDraw,
+    // mnPending is the latest complete snapshot, swapped with them under the lock.
+    sSnapshot mvSnapshots[3];
+    int mnWrite, mnPending, mnDraw;
+    bool mbPending;
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mbStop;
+    std::atomic<int> mnKey;
+    std::atomic<uint64_t> mnDropped;
+    std::thread mThread;
+};
+
+#endif // VIEWER_H
@@ -21,6 +21,8 @@
 */
 
 #include "ORBDetectAndDespMatcher.h"
+#include "result_sink.h"
+#include "trace.h"
 
 ORBDetectAndDespMatcher::ORBDetectAndDespMatcher(const Frame& pFrameRef, const Frame& pFrameCur,
                                                  ORB_SLAM2::ORBextractor* pORBextractorLeft,
@@ -30,7 +32,7 @@ ORBDetectAndDespMatcher::ORBDetectAndDespMatcher(const Frame& pFrameRef, const F
     mImgGrayRef(pFrameRef.mGray), mImgGrayCur(pFrameCur.mGray),
     mK(pFrameCur.mpCameraParams->mK), mDistCoef(pFrameCur.mpCameraParams->mDistCoef),
     mpORBextractorLeft(pORBextractorLeft), mpORBextractorRight(pORBextractorRight),
-    mSaveFolderPath(saveFolderPath)
+    mSaveFolderPath(saveFolderPath), mpResultSink(ResultSink::Get(saveFolderPath))
 {
     mfx = mK.at<float>(0,0); mfy = mK.at<float>(1,1);
     mcx = mK.at<float>(0,2); mcy = mK.at<float>(1,2);
@@ -53,6 +55,7 @@ void ORBDetectAndDespMatcher::ExtractORB(int flag, const cv::Mat& im)
 }
 
 void ORBDetectAndDespMatcher::FindFeatureMatches(){
+    TRACE_SCOPE("ORBDetectAndDespMatcher::FindFeatureMatches");
     std::thread threadLeft(&ORBDetectAndDespMatcher::ExtractORB, this, 0, mImgGrayRef);
     std::thread threadRight(&ORBDetectAndDespMatcher::ExtractORB, this, 1, mImgGrayCur);
     threadLeft.join();
@@ -80,14 +83,11 @@ void ORBDetectAndDespMatcher::FindFeatureMatches(){
             mvDMatches.push_back(m);
     }
 
-    // save results to files
-    std::stringstream s;
-    s << "RefKey Num: " << mvKeyPointsRef.size() << ", descriptorMatch Num: " << mvDMatchesByDescriptorMatch.size()
-      << ", fitler-out distance: " << mvDMatches.size();
-
-    std::string msg = "T: " + std::to_string(mTimeStamp) + ", " + s.str();
-    SaveMsgToFile("ORBDetectAndDespMatch.txt", msg);
-    // LOG(INFO) << msg;
+    // save results to files, formatted and written by the background thread of the sink
+    if(mpResultSink){
+        const float values[3] = {float(mvKeyPointsRef.size()), float(mvDMatchesByDescriptorMatch.size()), float(mvDMatches.size())};
+        mpResultSink->Push(ResultSink::ORB_MATCH, mTimeStamp, values, 3);
+    }
 }
 
 void ORBDetectAndDespMatcher::PoseEstimation2d2d()
@@ -104,18 +104,9 @@ void ORBDetectAndDespMatcher::PoseEstimation2d2d()
     cv::recoverPose(mE, points1, points2, mR, mt, (mfx+mfy)/2.0, cv::Point2d(mcx, mcy));
 }
 
-void ORBDetectAndDespMatcher::SaveMsgToFile(std::string filename, std::string &msg)
-{
-    std::ofstream fp(mSaveFolderPath + filename, ofstream::app);
-    if(!fp.is_open()) LOG(ERROR) << "cannot open: " << mSaveFolderPath + filename;
-    else {
-        fp << std::fixed << std::setprecision(6);
-        fp << msg << std::endl;
-    }
-}
-
 void ORBDetectAndDespMatcher::Display()
 {
+    TRACE_SCOPE("ORBDetectAndDespMatcher::Display");
     int h = mImgGrayCur.rows, w = mImgGrayCur.cols;
     cv::Mat im_out = cv::Mat(h, 2*w, CV_8UC1, cv::Scalar(0));
     mImgGrayRef.copyTo(im_out.rowRange(0, h).colRange(0, w));
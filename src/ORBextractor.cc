@@ -83,6 +83,8 @@
 #include <vector>
 
 #include "ORBextractor.h"
+#include "trace.h"
+#include "stage_scope.h"
 
 #include<chrono>
 #include <iostream>
@@ -502,6 +504,14 @@ static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, co
     }
 }
 
+// Index of the child node containing pt: 0: n1, 1: n2, 2: n3, 3: n4
+static inline int ChildIndex(const cv::Point2f &pt, const ExtractorNode &n1)
+{
+    if(pt.x<n1.UR.x)
+        return pt.y<n1.BR.y? 0: 2;
+    return pt.y<n1.BR.y? 1: 3;
+}
+
 void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4)
 {
     const int halfX = ceil(static_cast<float>(UR.x-UL.x)/2);
@@ -512,41 +522,35 @@ void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNo
     n1.UR = cv::Point2i(UL.x+halfX,UL.y);
     n1.BL = cv::Point2i(UL.x,UL.y+halfY);
     n1.BR = cv::Point2i(UL.x+halfX,UL.y+halfY);
-    n1.vKeys.reserve(vKeys.size());
 
     n2.UL = n1.UR;
     n2.UR = UR;
     n2.BL = n1.BR;
     n2.BR = cv::Point2i(UR.x,UL.y+halfY);
-    n2.vKeys.reserve(vKeys.size());
 
     n3.UL = n1.BL;
     n3.UR = n1.BR;
     n3.BL = BL;
     n3.BR = cv::Point2i(n1.BR.x,BL.y);
-    n3.vKeys.reserve(vKeys.size());
 
     n4.UL = n3.UR;
     n4.UR = n2.BR;
     n4.BL = n3.BR;
     n4.BR = BR;
-    n4.vKeys.reserve(vKeys.size());
+
+    //Count the points of each child, so that the arena only holds the exact sizes
+    ExtractorNode* vpChilds[4] = {&n1, &n2, &n3, &n4};
+    size_t vnKeys[4] = {0, 0, 0, 0};
+    for(size_t i=0;i<vKeys.size();i++)
+        vnKeys[ChildIndex(vKeys[i].pt, n1)]++;
+    for(int k=0;k<4;k++)
+        vpChilds[k]->vKeys.reserve(vnKeys[k]);
 
     //Associate points to childs
     for(size_t i=0;i<vKeys.size();i++)
     {
         const cv::KeyPoint &kp = vKeys[i];
-        if(kp.pt.x<n1.UR.x)
-        {
-            if(kp.pt.y<n1.BR.y)
-                n1.vKeys.push_back(kp);
-            else
-                n3.vKeys.push_back(kp);
-        }
-        else if(kp.pt.y<n1.BR.y)
-            n2.vKeys.push_back(kp);
-        else
-            n4.vKeys.push_back(kp);
+        vpChilds[ChildIndex(kp.pt, n1)]->vKeys.push_back(kp);
     }
 
     if(n1.vKeys.size()==1)
@@ -560,7 +564,7 @@ void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNo
 
 }
 
-vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
+vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const ArenaVector<cv::KeyPoint>& vToDistributeKeys, const int &minX,
                                        const int &maxX, const int &minY, const int &maxY, const int &N, const int &level)
 {
     // Compute how many initial nodes   
@@ -568,9 +572,11 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
 
     const float hX = static_cast<float>(maxX-minX)/nIni;
 
-    list<ExtractorNode> lNodes;
+    // The nodes and their keypoints are allocated from the frame arena
+    typedef list<ExtractorNode, ArenaAllocator<ExtractorNode> > NodeList;
+    NodeList lNodes;
 
-    vector<ExtractorNode*> vpIniNodes;
+    ArenaVector<ExtractorNode*> vpIniNodes;
     vpIniNodes.resize(nIni);
 
     for(int i=0; i<nIni; i++)
@@ -580,7 +586,6 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
         ni.UR = cv::Point2i(hX*static_cast<float>(i+1),0);
         ni.BL = cv::Point2i(ni.UL.x,maxY-minY);
         ni.BR = cv::Point2i(ni.UR.x,maxY-minY);
-        ni.vKeys.reserve(vToDistributeKeys.size());
 
         lNodes.push_back(ni);
         vpIniNodes[i] = &lNodes.back();
@@ -593,7 +598,7 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
         vpIniNodes[kp.pt.x/hX]->vKeys.push_back(kp);
     }
 
-    list<ExtractorNode>::iterator lit = lNodes.begin();
+    NodeList::iterator lit = lNodes.begin();
 
     while(lit!=lNodes.end())
     {
@@ -612,7 +617,7 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
 
     int iteration = 0;
 
-    vector<pair<int,ExtractorNode*> > vSizeAndPointerToNode;
+    ArenaVector<pair<int,ExtractorNode*> > vSizeAndPointerToNode;
     vSizeAndPointerToNode.reserve(lNodes.size()*4);
 
     while(!bFinish)
@@ -702,7 +707,7 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
 
                 prevSize = lNodes.size();
 
-                vector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
+                ArenaVector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
                 vSizeAndPointerToNode.clear();
 
                 sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end());
@@ -765,9 +770,9 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
     // Retain the best point in each node
     vector<cv::KeyPoint> vResultKeys;
     vResultKeys.reserve(nfeatures);
-    for(list<ExtractorNode>::iterator lit=lNodes.begin(); lit!=lNodes.end(); lit++)
+    for(NodeList::iterator lit=lNodes.begin(); lit!=lNodes.end(); lit++)
     {
-        vector<cv::KeyPoint> &vNodeKeys = lit->vKeys;
+        ArenaVector<cv::KeyPoint> &vNodeKeys = lit->vKeys;
         cv::KeyPoint* pKP = &vNodeKeys[0];
         float maxResponse = pKP->response;
 
@@ -786,21 +791,24 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
     return vResultKeys;
 }
 
-void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints)
+void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoints, const OccupancyGrid* pOccupancy)
 {
     allKeypoints.resize(nlevels);
 
-    const float W = 30;
+    const float W = CELL_SIZE;
 
     for (int level = 0; level < nlevels; ++level)
     {
+        TRACE_SCOPE_ARG("ComputeKeyPointsLevel", level);
+        ArenaScope arenaScope;  // the keypoints to distribute and the oct-tree nodes are released after each level
         const int minBorderX = EDGE_THRESHOLD-3;
         const int minBorderY = minBorderX;
         const int maxBorderX = mvImagePyramid[level].cols-EDGE_THRESHOLD+3;
         const int maxBorderY = mvImagePyramid[level].rows-EDGE_THRESHOLD+3;
 
-        vector<cv::KeyPoint> vToDistributeKeys;
+        ArenaVector<cv::KeyPoint> vToDistributeKeys;
         vToDistributeKeys.reserve(nfeatures*10);
+        vector<cv::KeyPoint> vKeysCell;     // reused by the cells
 
         const float width = (maxBorderX-minBorderX);
         const float height = (maxBorderY-minBorderY);
@@ -829,7 +837,15 @@ void ORBextractor::ComputeKeyPointsOctTree(vector<vector<KeyPoint> >& allKeypoin
                 if(maxX>maxBorderX)
                     maxX = maxBorderX;
 
-                vector<cv::KeyPoint> vKeysCell;
+                // skip the cells fully occupied (e.g. by tracked features), in the coordinates of level 0
+                if(pOccupancy)
+                {
+                    const float scale = mvScaleFactor[level];
+                    if(pOccupancy->IsRegionOccupied(iniX*scale, iniY*scale, maxX*scale, maxY*scale))
+                        continue;
+                }
+
+                vKeysCell.clear();
                 FAST(mvImagePyramid[level].rowRange(iniY,maxY).colRange(iniX,maxX),
                      vKeysCell,iniThFAST,true);
 
@@ -1066,6 +1082,8 @@ static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Ma
 void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
                       OutputArray _descriptors)
 { 
+    TRACE_SCOPE("ORBextractor::Extract");
+    STAGE_SCOPE("orb_extract");
     if(_image.empty())
         return;
 
@@ -1150,8 +1168,21 @@ void ORBextractor::DetectFeatures(InputArray _image, InputArray _mask, vector<Ke
     if(_image.empty())
         return;
 
-    Mat image = _image.getMat();
-    Mat mask = _mask.getMat();
+    DetectFeatures(_image.getMat(), _mask.getMat(), NULL, _keypoints);
+}
+
+void ORBextractor::DetectFeatures(InputArray _image, const OccupancyGrid &occupancy, vector<KeyPoint>& _keypoints)
+{
+    if(_image.empty())
+        return;
+
+    DetectFeatures(_image.getMat(), Mat(), &occupancy, _keypoints);
+}
+
+void ORBextractor::DetectFeatures(const Mat &image, const Mat &mask, const OccupancyGrid* pOccupancy, vector<KeyPoint>& _keypoints)
+{
+    TRACE_SCOPE("ORBextractor::DetectFeatures");
+    STAGE_SCOPE("orb_detect");
     assert(image.type() == CV_8UC1 );
 
     std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
@@ -1166,7 +1197,7 @@ void ORBextractor::DetectFeatures(InputArray _image, InputArray _mask, vector<Ke
     std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
 
     vector < vector<KeyPoint> > allKeypoints;
-    ComputeKeyPointsOctTree(allKeypoints);
+    ComputeKeyPointsOctTree(allKeypoints, pOccupancy);
 
     std::chrono::steady_clock::time_point t4 = std::chrono::steady_clock::now();    // start timer
     mTimeOfComputeKeyPointsOctTree = 1000 * std::chrono::duration_cast<std::chrono::duration<double> >(t4 - t3).count();
@@ -1197,9 +1228,14 @@ void ORBextractor::DetectFeatures(InputArray _image, InputArray _mask, vector<Ke
 
         // And add the keypoints to the output
         for(auto key:keypoints){
-            // discard the points that mask is zero
-            if(mask.at<uchar>(int(key.pt.y), int(key.pt.x)))
-                _keypoints.push_back(key);
+            // discard the points in occupied cells, or where the mask is zero
+            if(pOccupancy){
+                if(pOccupancy->IsOccupied(key.pt))
+                    continue;
+            }
+            else if(!mask.empty() && !mask.at<uchar>(int(key.pt.y), int(key.pt.x)))
+                continue;
+            _keypoints.push_back(key);
         }
     }
 }
@@ -1208,6 +1244,7 @@ void ORBextractor::ComputePyramid(cv::Mat image)
 {
     for (int level = 0; level < nlevels; ++level)
     {
+        TRACE_SCOPE_ARG("ComputePyramidLevel", level);
         float scale = mvInvScaleFactor[level];
         Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
         Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
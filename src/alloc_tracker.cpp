@@ -0,0 +1,234 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "alloc_tracker.h"
+
+#ifdef ENABLE_ALLOC_TRACKING
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+
+#include "metrics.h"
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+namespace {
+
+struct sStage
+{
+    const char* name;
+    std::atomic<uint64_t> nFrameCount, nFrameBytes;     // since the last EndFrame()
+    std::atomic<uint64_t> nTotalCount, nTotalBytes;
+    Histogram *pCount, *pBytes;
+};
+
+// Stage 0 collects the allocations outside of any scope
+sStage gvStages[AllocTracker::MAX_STAGES];
+std::atomic<int> gnStages(0);
+std::mutex gMutexStages;
+
+// Plain thread local storage: no constructor, so it is usable from operator new at any time
+__thread int gCurrentStage = 0;
+
+int gnWarmupFrames = 0;
+uint64_t gnMaxPerFrame = 0;
+std::atomic<uint64_t> gnFrames(0);
+std::atomic<uint64_t> gnViolations(0);
+Histogram* gpFrameCount = NULL;
+
+std::string SafeName(const char* name)
+{
+    std::string s(name);
+    for(size_t i = 0; i < s.size(); i++)
+        if(!isalnum(s[i])) s[i] = '_';
+    return s;
+}
+
+// Count the buffers of cv::Mat, which are not allocated by operator new (cv::fastMalloc)
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    CountingMatAllocator(): mpStdAllocator(cv::Mat::getStdAllocator()) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           int flags, cv::UMatUsageFlags usageFlags) const
+    {
+        cv::UMatData* u = mpStdAllocator->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if(u && !data)  // not a user provided buffer
+            AllocTracker::Count(u->size);
+        return u;
+    }
+
+    bool allocate(cv::UMatData* data, int accessflags, cv::UMatUsageFlags usageFlags) const
+    {
+        return mpStdAllocator->allocate(data, accessflags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const
+    {
+        mpStdAllocator->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator* mpStdAllocator;
+};
+
+} // namespace
+
+int AllocTracker::RegisterStage(const char* name)
+{
+    std::unique_lock<std::mutex> lock(gMutexStages);
+    if(gnStages == 0){
+        gvStages[0].name = "other";
+        gnStages = 1;
+    }
+    const int n = gnStages.load();
+    for(int i = 0; i < n; i++)
+        if(strcmp(gvStages[i].name, name) == 0)
+            return i;
+    if(n >= MAX_STAGES)
+        return 0;
+    gvStages[n].name = name;
+    gnStages = n + 1;
+    return n;
+}
+
+int AllocTracker::SetCurrentStage(int stage)
+{
+    const int previous = gCurrentStage;
+    gCurrentStage = stage;
+    return previous;
+}
+
+void AllocTracker::Count(size_t bytes)
+{
+    sStage &s = gvStages[gCurrentStage];
+    s.nFrameCount.fetch_add(1, std::memory_order_relaxed);
+    s.nFrameBytes.fetch_add(bytes, std::memory_order_relaxed);
+    s.nTotalCount.fetch_add(1, std::memory_order_relaxed);
+    s.nTotalBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void AllocTracker::InstallMatAllocator()
+{
+    static CountingMatAllocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+}
+
+void AllocTracker::SetBudget(int warmupFrames, uint64_t maxPerFrame)
+{
+    gnWarmupFrames = warmupFrames;
+    gnMaxPerFrame = maxPerFrame;
+}
+
+void AllocTracker::EndFrame()
+{
+    RegisterStage("other");     // make sure stage 0 is named
+    MetricsRegistry* pRegistry = MetricsRegistry::GetInstance();
+    if(!gpFrameCount)
+        gpFrameCount = pRegistry->GetHistogram("alloc_per_frame", "Heap allocations per frame", 1);
+
+    uint64_t nFrameCount = 0;
+    const int n = gnStages.load();
+    for(int k = 0; k < n; k++){
+        sStage &s = gvStages[k];
+        const uint64_t count = s.nFrameCount.exchange(0, std::memory_order_relaxed);
+        const uint64_t bytes = s.nFrameBytes.exchange(0, std::memory_order_relaxed);
+        if(!s.pCount){
+            const std::string prefix = "alloc_" + SafeName(s.name);
+            s.pCount = pRegistry->GetHistogram(prefix + "_per_frame", std::string("Heap allocations per frame in ") + s.name, 1);
+            s.pBytes = pRegistry->GetHistogram(prefix + "_bytes_per_frame", std::string("Heap allocated bytes per frame in ") + s.name, 1);
+        }
+        s.pCount->Record(count);
+        s.pBytes->Record(bytes);
+        nFrameCount += count;
+    }
+    gpFrameCount->Record(nFrameCount);
+
+    const uint64_t nFrames = ++gnFrames;
+    if(gnMaxPerFrame > 0 && nFrames > uint64_t(gnWarmupFrames) && nFrameCount > gnMaxPerFrame){
+        if(gnViolations++ == 0)
+            LOG(ERROR) << "allocation regression: " << nFrameCount << " allocations in frame " << nFrames
+                       << ", budget " << gnMaxPerFrame;
+    }
+}
+
+bool AllocTracker::BudgetExceeded()
+{
+    return gnViolations > 0;
+}
+
+void AllocTracker::Report()
+{
+    const int n = gnStages.load();
+    const uint64_t nFrames = std::max<uint64_t>(1, gnFrames.load());
+    for(int k = 0; k < n; k++){
+        const sStage &s = gvStages[k];
+        LOG(INFO) << "alloc " << s.name << ": " << s.nTotalCount / nFrames << " allocations and "
+                  << s.nTotalBytes / nFrames << " bytes per frame";
+    }
+    if(gnViolations > 0)
+        LOG(ERROR) << "allocation budget exceeded in " << gnViolations << " frames";
+}
+
+// Replaced global allocation functions
+void* operator new(size_t size)
+{
+    AllocTracker::Count(size);
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    AllocTracker::Count(size);
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    AllocTracker::Count(size);
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    AllocTracker::Count(size);
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept {free(p);}
+void operator delete[](void* p) noexcept {free(p);}
+void operator delete(void* p, const std::nothrow_t&) noexcept {free(p);}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {free(p);}
+
+#endif // ENABLE_ALLOC_TRACKING
@@ -0,0 +1,106 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "feature_budget.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+const float GAIN = 0.5f;            // budget *= (target / latency)^GAIN
+const float MAX_DECREASE = 0.8f;    // per frame
+const float MAX_INCREASE = 1.05f;   // per frame
+const float DEAD_BAND = 0.1f;       // do not increase while the latency is within 10% below the target
+const size_t MIN_SAMPLES = 5;
+
+struct sBudgetMetrics{
+    Histogram* pBudget;
+    sBudgetMetrics(){
+        MetricsRegistry* pRegistry = MetricsRegistry::GetInstance();
+        pBudget = pRegistry->GetHistogram("feature_budget", "Number of features per frame allowed by the latency controller", 1);
+    }
+};
+
+sBudgetMetrics& GetBudgetMetrics()
+{
+    static sBudgetMetrics metrics;
+    return metrics;
+}
+
+}
+
+FeatureBudgetController::FeatureBudgetController(int maxFeatures, int minFeatures, float targetLatency,
+                                                 float percentile, int window):
+    mnMaxFeatures(maxFeatures), mnMinFeatures(std::min(std::max(minFeatures, 0), maxFeatures)),
+    mfTargetLatency(targetLatency), mfPercentile(std::min(std::max(percentile, 0.0f), 1.0f)),
+    mnBudget(maxFeatures), mfBudget(maxFeatures),
+    mvLatencies(std::max(window, 1), 0.0f), mnNext(0), mnSamples(0)
+{
+    mvSorted.reserve(mvLatencies.size());
+}
+
+float FeatureBudgetController::GetLatencyPercentile() const
+{
+    if(mnSamples == 0)
+        return -1;
+
+    mvSorted.assign(mvLatencies.begin(), mvLatencies.begin() + mnSamples);
+    const size_t k = std::min(mnSamples - 1, size_t(mfPercentile * mnSamples));
+    std::nth_element(mvSorted.begin(), mvSorted.begin() + k, mvSorted.end());
+    return mvSorted[k];
+}
+
+void FeatureBudgetController::Update(float latency)
+{
+    if(!IsEnabled())
+        return;
+
+    mvLatencies[mnNext] = latency;
+    mnNext = (mnNext + 1) % mvLatencies.size();
+    mnSamples = std::min(mnSamples + 1, mvLatencies.size());
+    if(mnSamples < std::min(MIN_SAMPLES, mvLatencies.size()))
+        return;
+
+    const float p = GetLatencyPercentile();
+    if(p <= 0)
+        return;
+
+    const float ratio = mfTargetLatency / p;
+    if(ratio < 1.0f)
+        mfBudget *= std::max(MAX_DECREASE, std::pow(ratio, GAIN));
+    else if(ratio > 1.0f / (1.0f - DEAD_BAND))
+        mfBudget *= std::min(MAX_INCREASE, std::pow(ratio, GAIN));
+
+    mfBudget = std::min(std::max(mfBudget, float(mnMinFeatures)), float(mnMaxFeatures));
+    const int nBudget = int(mfBudget + 0.5f);
+
+    // the window only measures the current budget, so that one overrun is not corrected several times
+    if(nBudget != mnBudget){
+        mnBudget = nBudget;
+        mnSamples = 0;
+        mnNext = 0;
+    }
+
+    GetBudgetMetrics().pBudget->Record(mnBudget);
+}
@@ -0,0 +1,119 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "feature_table.h"
+
+void FeatureTable::Resize(size_t n)
+{
+    mN = n;
+    uRef.assign(n, 0.0f); vRef.assign(n, 0.0f);
+    uPred.assign(n, 0.0f); vPred.assign(n, 0.0f);
+    uPredUn.assign(n, 0.0f); vPredUn.assign(n, 0.0f);
+    uGyroUn.assign(n, 0.0f); vGyroUn.assign(n, 0.0f);
+    uFlow.assign(n, 0.0f); vFlow.assign(n, 0.0f);
+    for (int j = 0; j < CORNERS; j++) {
+        uCorner[j].assign(n, 0.0f);
+        vCorner[j].assign(n, 0.0f);
+    }
+    a11.assign(n, 1.0f); a12.assign(n, 0.0f);
+    a21.assign(n, 0.0f); a22.assign(n, 1.0f);
+    uMatch.assign(n, 0.0f); vMatch.assign(n, 0.0f);
+    uMatchUn.assign(n, 0.0f); vMatchUn.assign(n, 0.0f);
+    ncc.assign(n, 0.0f);
+    error.assign(n, 0.0f);
+
+    predicted.Resize(n);
+    matched.Resize(n);
+    tracked.Resize(n);
+}
+
+void FeatureTable::swap(FeatureTable &t)
+{
+    std::swap(mN, t.mN);
+    uRef.swap(t.uRef); vRef.swap(t.vRef);
+    uPred.swap(t.uPred); vPred.swap(t.vPred);
+    uPredUn.swap(t.uPredUn); vPredUn.swap(t.vPredUn);
+    uGyroUn.swap(t.uGyroUn); vGyroUn.swap(t.vGyroUn);
+    uFlow.swap(t.uFlow); vFlow.swap(t.vFlow);
+    for (int j = 0; j < CORNERS; j++) {
+        uCorner[j].swap(t.uCorner[j]);
+        vCorner[j].swap(t.vCorner[j]);
+    }
+    a11.swap(t.a11); a12.swap(t.a12);
+    a21.swap(t.a21); a22.swap(t.a22);
+    uMatch.swap(t.uMatch); vMatch.swap(t.vMatch);
+    uMatchUn.swap(t.uMatchUn); vMatchUn.swap(t.vMatchUn);
+    ncc.swap(t.ncc);
+    error.swap(t.error);
+
+    predicted.swap(t.predicted);
+    matched.swap(t.matched);
+    tracked.swap(t.tracked);
+}
+
+void FeatureTable::SetReference(const std::vector<cv::KeyPoint> &vKeysUn)
+{
+    for (size_t i = 0; i < mN; i++) {
+        uRef[i] = vKeysUn[i].pt.x;
+        vRef[i] = vKeysUn[i].pt.y;
+    }
+}
+
+void FeatureTable::GetPredicted(std::vector<cv::Point2f> &vPts, std::vector<cv::Point2f> &vPtsUn) const
+{
+    vPts.resize(mN);
+    vPtsUn.resize(mN);
+    for (size_t i = 0; i < mN; i++) {
+        vPts[i] = cv::Point2f(uPred[i], vPred[i]);
+        vPtsUn[i] = cv::Point2f(uPredUn[i], vPredUn[i]);
+    }
+}
+
+void FeatureTable::SetPredicted(const std::vector<cv::Point2f> &vPts, const std::vector<cv::Point2f> &vPtsUn)
+{
+    for (size_t i = 0; i < mN; i++) {
+        uPred[i] = vPts[i].x; vPred[i] = vPts[i].y;
+        uPredUn[i] = vPtsUn[i].x; vPredUn[i] = vPtsUn[i].y;
+    }
+}
+
+void FeatureTable::GetGyroPredictedUn(std::vector<cv::Point2f> &vPtsUn) const
+{
+    vPtsUn.resize(mN);
+    for (size_t i = 0; i < mN; i++)
+        vPtsUn[i] = cv::Point2f(uGyroUn[i], vGyroUn[i]);
+}
+
+void FeatureTable::GetStatus(const BitMask &flags, std::vector<uchar> &vStatus) const
+{
+    vStatus.resize(mN);
+    for (size_t i = 0; i < mN; i++)
+        vStatus[i] = flags.Test(i);
+}
+
+void FeatureTable::SetStatus(const std::vector<uchar> &vStatus, BitMask &flags)
+{
+    flags.Resize(mN);
+    for (size_t i = 0; i < mN; i++)
+        if (vStatus[i])
+            flags.Set(i);
+}
@@ -23,20 +23,29 @@
 #include "frame.h"
 #include "../Thirdparty/glog/include/glog/logging.h"
 #include "utils.h"
+#include "trace.h"
+#include "stage_scope.h"
+#include "viewer.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
-long unsigned int Frame::nNextId = 0;
+// Cells of the occupancy grid: a fifth of the FAST cells of the detector, so that a tracked feature
+// blocks about the same area as a 14x14 window
+static const int OCCUPANCY_CELL_SIZE = ORB_SLAM2::ORBextractor::CELL_SIZE / 5;
 
-Frame::Frame()
+Frame::Frame():
+    mpContext(NULL)
 {
     mnId = 0;
 }
 
 Frame::Frame(const Frame& frame):
+    mpContext(frame.mpContext),
     mnId(frame.mnId),
     mN(frame.mN),
     mTimeStamp(frame.mTimeStamp),
-    mGray(frame.mGray.clone()), mGrayDistort(frame.mGrayDistort.clone()),
+    mGray(frame.mGray.clone()), mGrayDistort(frame.mGrayDistort),
     mpLastFrame(frame.mpLastFrame),
     mRcl(frame.mRcl.clone()),
     mpCameraParams(frame.mpCameraParams),
@@ -45,40 +54,49 @@ Frame::Frame(const Frame& frame):
     mvKeysNormal(frame.mvKeysNormal),
     mvFlowVelocityInNormalPlane(frame.mvFlowVelocityInNormalPlane),
     mvPtIndexInLastFrame(frame.mvPtIndexInLastFrame),
+    mvTrackIds(frame.mvTrackIds),
     mfx(frame.mfx), mfy(frame.mfy), mcx(frame.mcx), mcy(frame.mcy),
     mfx_inv(frame.mfx_inv), mfy_inv(frame.mfy_inv),
     mThresholdOfPredictNewKeyPoint(frame.mThresholdOfPredictNewKeyPoint)
 {
-    mMask = cv::Mat::ones(mGray.rows, mGray.cols, CV_8UC1);
+    mOccupancy.Reset(mGray.cols, mGray.rows, OCCUPANCY_CELL_SIZE);
     mRcl = cv::Mat();
-    curFrameWithoutGeometryValid = nullptr;
-
 }
 
 Frame::Frame(double &t, cv::Mat &im, cv::Mat &im_dist, Frame* pLastFrame, CameraParams *pCameraParams,
              ORB_SLAM2::ORBextractor* pORBextractor,
-             std::vector<IMU::Point> &vImu, int keypointNumber, double th):
-    mTimeStamp(t), mpLastFrame(pLastFrame),
-    mpCameraParams(pCameraParams),
-    mvImuFromLastFrame(vImu),
-    mN(keypointNumber), mGrayDistort(im_dist)
+             std::vector<IMU::Point> &vImu, int keypointNumber, double th, TrackingContext* pContext)
 {
-    mnId = nNextId ++;
+    Init(t, im, im_dist, pLastFrame, pCameraParams, pORBextractor, vImu, keypointNumber, th, pContext);
+}
+
+void Frame::Init(double t, const cv::Mat &im, const cv::Mat &im_dist, Frame* pLastFrame, CameraParams *pCameraParams,
+                 ORB_SLAM2::ORBextractor* pORBextractor,
+                 const std::vector<IMU::Point> &vImu, int keypointNumber, double th, TrackingContext* pContext,
+                 bool bRectify)
+{
+    mpContext = pContext? pContext: TrackingContext::GetDefault();
+    mnId = mpContext->NewFrameId();
+    mTimeStamp = t;
+    mpLastFrame = pLastFrame;
+    mpCameraParams = pCameraParams;
+    mvImuFromLastFrame.assign(vImu.begin(), vImu.end());
+    mN = keypointNumber;
+    if(mpContext->mbRetainDistortedImage)
+        mGrayDistort = im_dist;
+    else
+        mGrayDistort.release();
 
     mfx = mpCameraParams->mK.at<float>(0,0); mfy = mpCameraParams->mK.at<float>(1,1);
     mcx = mpCameraParams->mK.at<float>(0,2); mcy = mpCameraParams->mK.at<float>(1,2);
     mfx_inv = 1.0 / mfx; mfy_inv = 1.0 / mfy;
 
-    mvKeys.reserve(mN);
-    mvKeysUn.reserve(mN);
-    mvKeysNormal.reserve(mN);
-    mvFlowVelocityInNormalPlane.resize(mN);
-
-    mvPtIndexInLastFrame.reserve(mN);
-
     mThresholdOfPredictNewKeyPoint = mN * th;
 
-    if(im.channels() == 3)
+    // Rectify(), cvtColor() and copyTo() reuse the buffer of a recycled frame
+    if(bRectify)
+        GrayRectifier::Rectify(im, mpCameraParams->M1, mpCameraParams->M2, mGray);
+    else if(im.channels() == 3)
         cv::cvtColor(im, mGray, CV_RGB2GRAY);
     else if(im.channels() == 4)
         cv::cvtColor(im, mGray, CV_RGBA2GRAY);
@@ -86,11 +104,18 @@ Frame::Frame(double &t, cv::Mat &im, cv::Mat &im_dist, Frame* pLastFrame, Camera
         im.copyTo(mGray);
     }
 
-    mMask = cv::Mat::ones(im.rows, im.cols, CV_8UC1); // cv::Mat(im.rows, im.cols, CV_8UC1);
+    // clear the state of the previous use, and free all the cells
+    Reset();
 
-    mRcl = cv::Mat();
+    mvKeys.reserve(mN);
+    mvKeysUn.reserve(mN);
+    mvKeysNormal.reserve(mN);
+    mvFlowVelocityInNormalPlane.assign(mN, cv::Point2f(0, 0));
+
+    mvPtIndexInLastFrame.reserve(mN);
+    mvTrackIds.reserve(mN);
 
-    curFrameWithoutGeometryValid = nullptr;
+    mRcl = cv::Mat();
 }
 
 void Frame::Reset()
@@ -98,28 +123,71 @@ void Frame::Reset()
     mvKeys.clear();
     mvKeysUn.clear();
     mvKeysNormal.clear();
-    mvvFlowsPredictCorners.clear();
     mvFlowVelocityInNormalPlane.clear();
 
-    mMask = cv::Mat::ones(mGray.rows, mGray.cols, CV_8UC1);
+    mOccupancy.Reset(mGray.cols, mGray.rows, OCCUPANCY_CELL_SIZE);
 
     mvPtIndexInLastFrame.clear();
+    mvTrackIds.clear();
     mvPtPredict.clear();
     mvPtPredictUn.clear();
     mvPtGyroPredictUn.clear();
     mvStatus.clear();
-    mvNcc.clear();
+    mvStatusWithoutGeometryValid.clear();
+    mTracks.Resize(0);
 
 }
 
+// Keep at most n of the valid tracks, spread over the image: the tracks are bucketed in a coarse grid
+// (about 4 tracks per cell) and taken round-robin from the cells, so that every occupied cell keeps some tracks.
+static void SelectTracksUniformly(const std::vector<cv::Point2f> &vPts, std::vector<uchar> &vKeep,
+                                  int n, int width, int height)
+{
+    std::vector<int> vValid;
+    for (size_t i = 0, iend = vKeep.size(); i < iend; ++i)
+        if(vKeep[i])
+            vValid.push_back(i);
+    if(n < 0 || int(vValid.size()) <= n)
+        return;
+
+    const float cellSize = std::max(1.0f, std::sqrt(4.0f * width * height / std::max(n, 1)));
+    const int nCols = std::max(1, int(std::ceil(width / cellSize)));
+    const int nRows = std::max(1, int(std::ceil(height / cellSize)));
+    std::vector<std::vector<int> > vvCells(nCols * nRows);
+    for (size_t k = 0; k < vValid.size(); ++k)
+    {
+        const cv::Point2f &pt = vPts[vValid[k]];
+        const int c = std::min(std::max(int(pt.x / cellSize), 0), nCols - 1);
+        const int r = std::min(std::max(int(pt.y / cellSize), 0), nRows - 1);
+        vvCells[r * nCols + c].push_back(vValid[k]);
+        vKeep[vValid[k]] = 0;
+    }
+
+    int nKept = 0;
+    for (size_t round = 0; nKept < n; ++round)
+    {
+        for (size_t c = 0; c < vvCells.size() && nKept < n; ++c)
+        {
+            if(round < vvCells[c].size()){
+                vKeep[vvCells[c][round]] = 1;
+                nKept ++;
+            }
+        }
+    }
+}
+
 void Frame::SetPredictKeyPointsAndMask()
 {
     int half_path_size = 7;
     int cnt = 0;
-    cv::Mat roi = cv::Mat::zeros(half_path_size*2, half_path_size*2, CV_8UC1);
+
+    // Do not carry more tracks than the feature budget of this frame (mN)
+    std::vector<uchar> vKeep(mvStatus);
+    SelectTracksUniformly(mvPtPredictUn, vKeep, mN, mpCameraParams->width, mpCameraParams->height);
+
     for (size_t i = 0, iend = mvStatus.size(); i < iend; ++i)
     {
-        if(!mvStatus[i])
+        if(!vKeep[i])
             continue;
 
         cv::Point2f pt_pred = mvPtPredict[i];
@@ -133,6 +201,7 @@ void Frame::SetPredictKeyPointsAndMask()
         mvKeysUn.push_back(cv::KeyPoint(pt_pred_un, half_path_size));
         mvKeysNormal.push_back(cv::KeyPoint(pt_pred_normal, half_path_size));
         mvPtIndexInLastFrame.push_back(i);
+        mvTrackIds.push_back(mpLastFrame->mvTrackIds[i]);
 
         // When the feature is tracked from lastFrame, we calculate
         // its flow velocity in normalized plane for last frame.
@@ -144,24 +213,21 @@ void Frame::SetPredictKeyPointsAndMask()
 
         cnt ++;
 
-        // set mask
-        int _x = std::min(std::max(0, int(pt_pred_un.x) - half_path_size), mpCameraParams->width - roi.cols);
-        int _y = std::min(std::max(0, int(pt_pred_un.y) - half_path_size), mpCameraParams->height - roi.rows);
-        cv::Rect roi_rect = cv::Rect(_x, _y, roi.cols, roi.rows);
-        roi.copyTo(mMask(roi_rect));
+        // occupy the cells around the feature
+        mOccupancy.Mark(pt_pred_un, half_path_size);
     }
 }
 
 // Default. detect new feature when the predicted features is less than a threshold.
-void Frame::DetectKeyPoints(ORB_SLAM2::ORBextractor* pORBextractor)
+void Frame::DetectKeyPoints(ORB_SLAM2::ORBextractor* pORBextractor, GapDetector* pGapDetector)
 {
+    TRACE_SCOPE("DetectKeyPoints");
+    STAGE_SCOPE("detect_keypoints");
     SetPredictKeyPointsAndMask();
     int num_predicted = mvKeysUn.size();
 
-    static bool reach_max_feature_flag = false; // ensure to detect max feature
-
     // We detected new featrues only when the predicted features is less than a threshold.
-    if(num_predicted < mThresholdOfPredictNewKeyPoint || !reach_max_feature_flag)
+    if(num_predicted < mThresholdOfPredictNewKeyPoint || !mpContext->mbReachMaxFeature)
     {
         std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
@@ -169,27 +235,29 @@ void Frame::DetectKeyPoints(ORB_SLAM2::ORBextractor* pORBextractor)
         if (n_new <= 0) return;
 
         std::vector<cv::Point2f> corners_un;
-        if(pORBextractor){  // use ORBextractor
+        if(pGapDetector){   // only in the cells which lack features
+            pGapDetector->Detect(mGray, mvKeysUn, mOccupancy, mN, n_new, corners_un);
+        }else if(pORBextractor){  // use ORBextractor
             std::vector<cv::KeyPoint> keypoints;
-            pORBextractor->DetectFeatures(mGray, mMask, keypoints);
+            pORBextractor->DetectFeatures(mGray, mOccupancy, keypoints);
 
             for(auto key:keypoints){
                 if(corners_un.size() < n_new)
                     corners_un.push_back(key.pt);
             }
-        }else{  // use cv::goodFeaturesToTrack
-            int block_size = 3;
-            double min_distance = 20;
-            double quality_level = 0.005;
-            cv::goodFeaturesToTrack(mGray, corners_un, n_new, quality_level, min_distance, mMask, block_size, true, 0.04);
+        }else{  // use cv::goodFeaturesToTrack, in the free cells of the occupancy grid (no full resolution mask)
+            static thread_local GapDetector shiTomasiDetector(GapDetector::SHI_TOMASI, 60, 4, 20, 7, 20);
+            shiTomasiDetector.Detect(mGray, mvKeysUn, mOccupancy, mN, n_new, corners_un);
         }
 
         std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();    // start timer
         double timeOfDetectNewFeatures = 1000 * std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
 
+        uint64_t nTrackId = mpContext->NewTrackIds(corners_un.size());
         for (auto pt: corners_un) {
             mvKeysUn.push_back(cv::KeyPoint(pt, 0));
             mvPtIndexInLastFrame.push_back(-1);
+            mvTrackIds.push_back(nTrackId ++);
             float x_normal = (pt.x - mcx) * mfx_inv;
             float y_normal = (pt.y - mcy) * mfy_inv;
             mvKeysNormal.push_back(cv::KeyPoint(x_normal, y_normal, 1));
@@ -211,7 +279,7 @@ void Frame::DetectKeyPoints(ORB_SLAM2::ORBextractor* pORBextractor)
 //        LOG(INFO) << "timeOfDetectNewFeatures: " << timeOfDetectNewFeatures
 //                  << ", timeOfDistortPoints: " << timeOfDistortPoints;
 
-        reach_max_feature_flag = mvKeysUn.size() == mN;
+        mpContext->mbReachMaxFeature = mvKeysUn.size() == mN;
     }
 
     mN = mvKeysUn.size();
@@ -241,21 +309,27 @@ void Frame::LoadDetectedKeypointFromFile(std::string path)
     }
     fin.close();
 
+    LoadDetectedKeypoints(vNewPts.data(), vNewPts.size());
+}
+
+void Frame::LoadDetectedKeypoints(const cv::Point2f* pPts, int n)
+{
     // add new feature when the predicted features is less than a threshold.
     int num_predicted = mvKeysUn.size();
-    static bool reach_max_feature_flag = false; // ensure to detect max feature
 
     int n_new = mN - num_predicted;
-    if(n_new > 0 && (num_predicted < mThresholdOfPredictNewKeyPoint || !reach_max_feature_flag))
+    if(n_new > 0 && (num_predicted < mThresholdOfPredictNewKeyPoint || !mpContext->mbReachMaxFeature))
     {
         std::vector<cv::Point2f> corners_un;
-        for(auto pt: vNewPts){
-            if(mMask.at<uchar>(int(pt.y), int(pt.x)) == 0)
+        for(int i = 0; i < n; i++){
+            const cv::Point2f &pt = pPts[i];
+            if(mOccupancy.IsOccupied(pt))
                 continue;
 
             corners_un.push_back(pt);
             mvKeysUn.push_back(cv::KeyPoint(pt, 0));
             mvPtIndexInLastFrame.push_back(-1);
+            mvTrackIds.push_back(mpContext->NewTrackIds());
             float x_normal = (pt.x - mcx) * mfx_inv;
             float y_normal = (pt.y - mcy) * mfy_inv;
             mvKeysNormal.push_back(cv::KeyPoint(x_normal, y_normal, 1));
@@ -272,9 +346,7 @@ void Frame::LoadDetectedKeypointFromFile(std::string path)
             mvKeys.push_back(cv::KeyPoint(corners_dist[i], 0));
         }
 
-        reach_max_feature_flag = false;
-        if(mvKeysUn.size() >= mN)
-            reach_max_feature_flag = true;
+        mpContext->mbReachMaxFeature = mvKeysUn.size() >= mN;
     }
 
     mN = mvKeysUn.size();
@@ -321,155 +393,18 @@ void Frame::UndistortPoints(std::vector<cv::Point2f> &corners)
  */
 void Frame::Display(std::string winname, int drawFlowType, bool bDrawPatch, bool bDrawMistracks, bool bDrawGyroPredictPosition)
 {
-    cv::Scalar COLOR_BLUE(255, 0, 0);
-    cv::Scalar COLOR_GREEN(0, 255, 0);
-    cv::Scalar COLOR_RED(0, 0, 255);
-    cv::Scalar COLOR_WHITE(255, 255, 255);
-    cv::Scalar COLOR_YELLOW(0, 255, 255);
-
-    int margin = 10;
-    int h = mpCameraParams->height, w = mpCameraParams->width;
-    cv::Mat im_out = cv::Mat(h, 2 * w + margin, CV_8UC1, cv::Scalar(255));
-    mpLastFrame->mGray.copyTo(im_out.rowRange(0, h).colRange(0, w));
-    mGray.copyTo(im_out.rowRange(0, h).colRange(w+margin, 2*w+margin));
-
-    if(im_out.channels() < 3) //this should be always true
-        cv::cvtColor(im_out, im_out, CV_GRAY2BGR);
-
-    int cnt_new_detected = 0;
-    std::set<int> sPtIndexInLastFrame;
-    for(size_t i = 0, iend = mvKeysUn.size(); i < iend; i++){
-        if(mvKeysUn[i].size > 1){ // this keypoint is tracked by gyro prediction and patch matched.
-
-            sPtIndexInLastFrame.insert(mvPtIndexInLastFrame[i]); // record good tracks after geometric validation
-
-            // draw patches
-            if(bDrawPatch && mvvFlowsPredictCorners[mvPtIndexInLastFrame[i]].size() > 0){
-
-                // on current frame
-                cv::Point2f pt_cur = mvKeysUn[i].pt + cv::Point2f(w + margin,0);
-                cv::Point2f pt_tl = mvvFlowsPredictCorners[mvPtIndexInLastFrame[i]][0] + pt_cur;
-                cv::Point2f pt_tr = mvvFlowsPredictCorners[mvPtIndexInLastFrame[i]][1] + pt_cur;
-                cv::Point2f pt_bl = mvvFlowsPredictCorners[mvPtIndexInLastFrame[i]][2] + pt_cur;
-                cv::Point2f pt_br = mvvFlowsPredictCorners[mvPtIndexInLastFrame[i]][3] + pt_cur;
-
-                cv::line(im_out, pt_tl, pt_tr, COLOR_GREEN, 1, cv::LINE_AA);
-                cv::line(im_out, pt_tr, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
-                cv::line(im_out, pt_bl, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
-                cv::line(im_out, pt_tl, pt_bl, COLOR_GREEN, 1, cv::LINE_AA);
-
-                // on reference frame
-                cv::Point2f lr = pt_tr - pt_tl; int w = int(sqrt(lr.x * lr.x + lr.y * lr.y)/2.0 + 0.5);
-                cv::Point2f pt_ref = mpLastFrame->mvKeysUn[mvPtIndexInLastFrame[i]].pt;
-                pt_tl = cv::Point2f(-w, -w) + pt_ref;
-                pt_tr = cv::Point2f(w, -w) + pt_ref;
-                pt_bl = cv::Point2f(-w, w) + pt_ref;
-                pt_br = cv::Point2f(w, w) + pt_ref;
-                cv::line(im_out, pt_tl, pt_tr, COLOR_GREEN, 1, cv::LINE_AA);
-                cv::line(im_out, pt_tr, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
-                cv::line(im_out, pt_bl, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
-                cv::line(im_out, pt_tl, pt_bl, COLOR_GREEN, 1, cv::LINE_AA);
-            }
-        }
-        else {  // new predict feature
-            cnt_new_detected ++;
-        }
-    }
-
-    // tracked results
-    int circle_radius = 2;
-    int circle_thickness = -1;
-    int line_thickness = 1;
-    int cnt_total_tracks = 0, cnt_good_tracks = 0, cnt_bad_tracks = 0;
-
-    // draw the gyro predicd and patch-matched features that do not filter out by geometry validation
-    for(size_t i = 0, iend = curFrameWithoutGeometryValid->mvStatus.size(); i < iend; i++){
-        cv::Point2f pt_cur = curFrameWithoutGeometryValid->mvPtPredictUn[i] + cv::Point2f(w+margin,0);
-        cv::Point2f pt_ref = mpLastFrame->mvKeysUn[i].pt;
-
-        if(!curFrameWithoutGeometryValid->mvStatus[i]){ // Loss-tracked, red circle in reference frame
-            cv::circle(im_out, pt_ref, circle_radius, COLOR_BLUE, circle_thickness);
-            continue;
-        }
-
-        cnt_total_tracks ++;
-
-        if(bDrawMistracks && sPtIndexInLastFrame.find(i) == sPtIndexInLastFrame.end()){   // Mistracked, red circle, red line
-            cnt_bad_tracks ++;
-
-            cv::circle(im_out, pt_cur, circle_radius, COLOR_RED, circle_thickness); // Bad track, red circle in reference frame
-            cv::circle(im_out, pt_ref, circle_radius, COLOR_RED, circle_thickness); // Bad track, red circle in current frame
-
-            // draw flows
-            if (drawFlowType == 0)      // flow on the current frame
-                cv::line(im_out, pt_ref + cv::Point2f(w+margin, 0), pt_cur, COLOR_RED, line_thickness, cv::LINE_AA);
-            else if (drawFlowType == 1) // line across two frames
-                cv::line(im_out, pt_ref, pt_cur, COLOR_RED, line_thickness, cv::LINE_AA);
-        }else {
-            cnt_good_tracks ++;
-
-            cv::circle(im_out, pt_ref, circle_radius, COLOR_GREEN, circle_thickness);   // Good track, green circle in reference frame
-            cv::circle(im_out, pt_cur, circle_radius, COLOR_GREEN, circle_thickness);   // Good track, green circle in current frame
-
-            // draw flows
-            if (drawFlowType == 0)      // flow on current frame
-                cv::line(im_out, pt_ref + cv::Point2f(w+margin, 0), pt_cur, COLOR_WHITE, line_thickness, cv::LINE_AA);
-            else if (drawFlowType == 1) // line across two frames
-                cv::line(im_out, pt_ref, pt_cur, COLOR_WHITE, line_thickness, cv::LINE_AA);
-        }
-
-        // draw gyro predict position
-        if(bDrawGyroPredictPosition && !curFrameWithoutGeometryValid->mvPtGyroPredictUn.empty()){
-             cv::Point2f pt_gyro = curFrameWithoutGeometryValid->mvPtGyroPredictUn[i] + cv::Point2f(w + margin,0);
-             if(pt_gyro.x != 0 && pt_gyro.y != 0){
-                 cv::circle(im_out, pt_gyro, circle_radius, COLOR_YELLOW, 1); // yellow circle
-             }
-        }
-    }
-
-
-    std::stringstream s;
-    int ref_kp_num = mvStatus.size();
-
-    s << std::fixed << std::setprecision(4)
-      << "Id: " << mnId
-      << ", T: " << std::to_string(mTimeStamp)
-      << ", RGT: " << 100.0 * cnt_good_tracks / ref_kp_num << "%"
-      << ", RGP: " << 100.0 * cnt_good_tracks / cnt_total_tracks << "%"
-         ;
-
-    cv::Size textSize = cv::getTextSize(s.str(),cv::FONT_HERSHEY_PLAIN,1,1,0);
-    cv::Mat imText = cv::Mat(im_out.rows + textSize.height + 10, im_out.cols, im_out.type());
-    im_out.copyTo(imText.rowRange(0, im_out.rows).colRange(0, im_out.cols));
-    imText.rowRange(im_out.rows, imText.rows) = cv::Mat::zeros(textSize.height + 10, im_out.cols, im_out.type());
-
-    cv::Scalar txt_color_fg(255, 255, 255);
-    cv::Scalar txt_color_bg(0, 0, 0);
-
-    cv::putText(imText, s.str(), cv::Point(5, imText.rows-5), cv::FONT_HERSHEY_PLAIN, 1, txt_color_fg, 1.0, cv::LINE_AA);
-
-    std::vector<std::string> vTxt;
-    if(!mvPtGyroPredictUn.empty()){
-        vTxt.push_back("Gyro-Aided KLT Feature Tracking");
-    }
-    else {  // for OPENCV_OPTICAL_FLOW_PYR_LK
-        vTxt.push_back("Image-only KLT Feature Tracking");
-    }
-
-    vTxt.push_back("ID: " + std::to_string(mnId));
-    vTxt.push_back("Keypoints: " + std::to_string(mpLastFrame->mvKeys.size()));
-    vTxt.push_back("Tracks: " + std::to_string(cnt_total_tracks)
-                   + " (G: " + std::to_string(cnt_good_tracks) + " | B: " + std::to_string(cnt_bad_tracks) + ")" );
-    std::stringstream s_rgt; s_rgt << std::fixed << std::setprecision(2) << "RGT: " << 100.0 * cnt_good_tracks / ref_kp_num << "%";
-    std::stringstream s_rgp; s_rgp << std::fixed << std::setprecision(2) << "RGP: " << 100.0 * cnt_good_tracks / cnt_total_tracks << "%";
-    vTxt.push_back(s_rgt.str() + ", " + s_rgp.str());
-
-    double sc = std::min(mGray.rows/640.0, 2.0);    // scale factor for consistent visualization across scales
-    int Ht = int(sc * 30);
-    for (size_t i = 0, iend = vTxt.size(); i < iend; i++) {
-        cv::putText(imText, vTxt[i], cv::Point(int(8*sc) + w + margin, Ht*(i+1)), cv::FONT_HERSHEY_DUPLEX, 1.0*sc, txt_color_bg, 2.0, cv::LINE_AA);
-        cv::putText(imText, vTxt[i], cv::Point(int(8*sc) + w + margin, Ht*(i+1)), cv::FONT_HERSHEY_DUPLEX, 1.0*sc, txt_color_fg, 1.0, cv::LINE_AA);
-    }
+    TRACE_SCOPE("Display");
+    STAGE_SCOPE("display");
+    Viewer::sOptions options;
+    options.drawFlowType = drawFlowType;
+    options.bDrawPatch = bDrawPatch;
+    options.bDrawMistracks = bDrawMistracks;
+    options.bDrawGyroPredictPosition = bDrawGyroPredictPosition;
+
+    Viewer::sSnapshot snapshot;
+    Viewer::TakeSnapshot(*this, options, snapshot);
+    cv::Mat imText;
+    Viewer::Draw(snapshot, imText);
 
     cv::imshow(winname, imText);
     cv::waitKey(1);
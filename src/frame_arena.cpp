@@ -0,0 +1,189 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frame_arena.h"
+#include "metrics.h"
+
+#include <mutex>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+
+namespace {
+
+// The arenas are owned here, so that EndFrame() can visit their (atomic) statistics
+std::mutex gMutexArenas;
+std::vector<std::unique_ptr<FrameArena> > gvArenas;
+
+struct sArenaMetrics
+{
+    sArenaMetrics()
+    {
+        MetricsRegistry* pRegistry = MetricsRegistry::GetInstance();
+        pPeakBytes = pRegistry->GetHistogram("arena_peak_bytes_per_frame", "Peak memory of the frame arenas (all threads) per frame", 1);
+        pReservedBytes = pRegistry->GetHistogram("arena_reserved_bytes", "Memory reserved by the frame arenas (all threads)", 1);
+        pBlocks = pRegistry->GetCounter("arena_block_allocations_total", "Blocks allocated by the frame arenas from the heap");
+    }
+
+    Histogram *pPeakBytes, *pReservedBytes;
+    Counter *pBlocks;
+};
+
+sArenaMetrics& GetArenaMetrics()
+{
+    static sArenaMetrics metrics;
+    return metrics;
+}
+
+} // namespace
+
+FrameArena::FrameArena(size_t blockSize):
+    mnBlockSize(blockSize), mnBlock(0), mnOffset(0), mnUsedBefore(0), mnScopes(0),
+    mnPeakBytes(0), mnReservedBytes(0)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for(size_t k = 0; k < mvBlocks.size(); k++)
+        ::operator delete(mvBlocks[k].pData);
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+    while(mnBlock < mvBlocks.size()){
+        const sBlock &block = mvBlocks[mnBlock];
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(block.pData);
+        const uintptr_t p = (begin + mnOffset + alignment - 1) & ~uintptr_t(alignment - 1);
+        if(p + bytes <= begin + block.nSize){
+            mnOffset = p + bytes - begin;
+            const size_t used = mnUsedBefore + mnOffset;
+            if(used > mnPeakBytes.load(std::memory_order_relaxed))
+                mnPeakBytes.store(used, std::memory_order_relaxed);
+            return reinterpret_cast<void*>(p);
+        }
+
+        // Continue in the next retained block
+        mnUsedBefore += block.nSize;
+        mnBlock ++;
+        mnOffset = 0;
+    }
+
+    return AllocateNewBlock(bytes, alignment);
+}
+
+void* FrameArena::AllocateNewBlock(size_t bytes, size_t alignment)
+{
+    sBlock block;
+    block.nSize = std::max(mnBlockSize, bytes + alignment);
+    block.pData = static_cast<char*>(::operator new(block.nSize));
+    mvBlocks.push_back(block);
+    mnBlock = mvBlocks.size() - 1;
+    mnOffset = 0;
+    mnReservedBytes.fetch_add(block.nSize, std::memory_order_relaxed);
+    GetArenaMetrics().pBlocks->Add();
+
+    return Allocate(bytes, alignment);
+}
+
+void FrameArena::Rewind(const sMarker &m)
+{
+    mnBlock = m.nBlock;
+    mnOffset = m.nOffset;
+    mnUsedBefore = m.nUsedBefore;
+}
+
+void FrameArena::Reset()
+{
+    assert(mnScopes == 0);
+
+    // Merge the blocks, the next frames of the same size fit in one block (the reserved size does not change)
+    if(mvBlocks.size() > 1){
+        const size_t nTotal = GetReservedBytes();
+        for(size_t k = 0; k < mvBlocks.size(); k++)
+            ::operator delete(mvBlocks[k].pData);
+        mvBlocks.clear();
+
+        sBlock block;
+        block.nSize = nTotal;
+        block.pData = static_cast<char*>(::operator new(block.nSize));
+        mvBlocks.push_back(block);
+        GetArenaMetrics().pBlocks->Add();
+    }
+
+    mnBlock = 0;
+    mnOffset = 0;
+    mnUsedBefore = 0;
+}
+
+size_t FrameArena::GetReservedBytes() const
+{
+    size_t n = 0;
+    for(size_t k = 0; k < mvBlocks.size(); k++)
+        n += mvBlocks[k].nSize;
+    return n;
+}
+
+void FrameArena::OpenScope()
+{
+    mnScopes ++;
+}
+
+void FrameArena::CloseScope(const sMarker &m)
+{
+    assert(mnScopes > 0);
+    mnScopes --;
+    Rewind(m);
+}
+
+FrameArena* FrameArena::GetThreadLocal()
+{
+    static thread_local FrameArena* pArena = NULL;
+    if(!pArena){
+        std::unique_lock<std::mutex> lock(gMutexArenas);
+        gvArenas.push_back(std::unique_ptr<FrameArena>(new FrameArena()));
+        pArena = gvArenas.back().get();
+    }
+    return pArena;
+}
+
+void FrameArena::EndFrame()
+{
+    // Only the arena of the calling thread is reset, the other threads (the other streams and the workers)
+    // are not touched: a worker arena is rewound by the ArenaScope of its task.
+    GetThreadLocal()->Reset();
+
+    size_t nPeak = 0, nReserved = 0;
+    {
+        std::unique_lock<std::mutex> lock(gMutexArenas);
+        for(size_t k = 0; k < gvArenas.size(); k++){
+            nPeak += gvArenas[k]->mnPeakBytes.exchange(0, std::memory_order_relaxed);
+            nReserved += gvArenas[k]->mnReservedBytes.load(std::memory_order_relaxed);
+        }
+    }
+
+    sArenaMetrics &metrics = GetArenaMetrics();
+    metrics.pPeakBytes->Record(nPeak);
+    metrics.pReservedBytes->Record(nReserved);
+}
@@ -0,0 +1,53 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "frame_pool.h"
+
+FramePool::FramePool(size_t n)
+{
+    mvpFrames.reserve(n);
+    mvpFree.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        mvpFrames.push_back(std::unique_ptr<Frame>(new Frame()));
+        mvpFree.push_back(mvpFrames.back().get());
+    }
+}
+
+Frame* FramePool::Acquire()
+{
+    if(mvpFree.empty()){
+        mvpFrames.push_back(std::unique_ptr<Frame>(new Frame()));
+        return mvpFrames.back().get();
+    }
+
+    Frame* pFrame = mvpFree.back();
+    mvpFree.pop_back();
+    return pFrame;
+}
+
+void FramePool::Release(Frame* pFrame)
+{
+    if(pFrame){
+        pFrame->mGrayDistort.release();     // do not keep the raw input alive while the frame is unused
+        mvpFree.push_back(pFrame);
+    }
+}
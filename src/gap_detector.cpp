@@ -0,0 +1,149 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gap_detector.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "trace.h"
+#include "metrics.h"
+
+namespace {
+
+bool CompareResponse(const cv::KeyPoint &k1, const cv::KeyPoint &k2)
+{
+    return k1.response > k2.response;
+}
+
+struct sGapMetrics{
+    Histogram* pSearchedArea;
+    sGapMetrics(){
+        MetricsRegistry* pRegistry = MetricsRegistry::GetInstance();
+        pSearchedArea = pRegistry->GetHistogram("gap_detector_searched_area_ratio", "Fraction of the image searched by the gap-filling detection", 1e4);
+    }
+};
+
+sGapMetrics& GetGapMetrics()
+{
+    static sGapMetrics metrics;
+    return metrics;
+}
+
+} // namespace
+
+GapDetector::GapDetector(eDetector detector, int cellSize, int margin, int iniThFAST, int minThFAST, float minDistance):
+    mDetector(detector), mnCellSize(std::max(cellSize, 8)), mnMargin(std::max(margin, 0)),
+    mnIniThFAST(iniThFAST), mnMinThFAST(minThFAST), mfMinDistance(minDistance)
+{
+}
+
+void GapDetector::Detect(const cv::Mat &gray, const std::vector<cv::KeyPoint> &vTracked, const OccupancyGrid &occupancy,
+                         int nFeatures, int nNew, std::vector<cv::Point2f> &vNewPts)
+{
+    TRACE_SCOPE("GapDetector::Detect");
+    if(gray.empty() || nNew <= 0){
+        GetGapMetrics().pSearchedArea->Record(0);
+        return;
+    }
+
+    const int nCols = (gray.cols + mnCellSize - 1) / mnCellSize;
+    const int nRows = (gray.rows + mnCellSize - 1) / mnCellSize;
+    const int nCells = nCols * nRows;
+
+    // tracked features per cell
+    mvDeficit.assign(nCells, 0);
+    for(size_t i = 0, iend = vTracked.size(); i < iend; i++){
+        const int c = std::min(std::max(int(vTracked[i].pt.x) / mnCellSize, 0), nCols - 1);
+        const int r = std::min(std::max(int(vTracked[i].pt.y) / mnCellSize, 0), nRows - 1);
+        mvDeficit[r * nCols + c] ++;
+    }
+
+    // deficit of each cell w.r.t. an even share of the features
+    const int nTarget = std::max(1, (nFeatures + nCells - 1) / nCells);
+    mvCells.clear();
+    for(int k = 0; k < nCells; k++){
+        mvDeficit[k] = nTarget - mvDeficit[k];
+        if(mvDeficit[k] > 0)
+            mvCells.push_back(k);
+    }
+    std::stable_sort(mvCells.begin(), mvCells.end(), [this](int k1, int k2){return mvDeficit[k1] > mvDeficit[k2];});
+
+    int nSearched = 0;
+    const size_t nBegin = vNewPts.size();
+    for(size_t i = 0; i < mvCells.size() && int(vNewPts.size() - nBegin) < nNew; i++){
+        const int k = mvCells[i];
+        const cv::Rect cell = cv::Rect((k % nCols) * mnCellSize, (k / nCols) * mnCellSize, mnCellSize, mnCellSize)
+                & cv::Rect(0, 0, gray.cols, gray.rows);
+        if(occupancy.IsRegionOccupied(cell.x, cell.y, cell.x + cell.width, cell.y + cell.height))
+            continue;
+
+        const int quota = std::min(mvDeficit[k], nNew - int(vNewPts.size() - nBegin));
+        DetectInCell(gray, cell, occupancy, quota, vNewPts);
+        nSearched += cell.area();
+    }
+    GetGapMetrics().pSearchedArea->Record(double(nSearched) / gray.total());
+}
+
+void GapDetector::DetectInCell(const cv::Mat &gray, const cv::Rect &cell, const OccupancyGrid &occupancy, int quota,
+                               std::vector<cv::Point2f> &vNewPts)
+{
+    // the corners are searched in the cell plus the margin, but only the ones inside the cell are kept,
+    // so that the neighbouring cells do not detect the same corners
+    const cv::Rect roi = cv::Rect(cell.x - mnMargin, cell.y - mnMargin, cell.width + 2 * mnMargin, cell.height + 2 * mnMargin)
+            & cv::Rect(0, 0, gray.cols, gray.rows);
+    const cv::Point2f offset(roi.x, roi.y);
+    const cv::Mat im = gray(roi);
+
+    mvKeysCell.clear();
+    if(mDetector == FAST){
+        cv::FAST(im, mvKeysCell, mnIniThFAST, true);
+        if(mvKeysCell.empty())
+            cv::FAST(im, mvKeysCell, mnMinThFAST, true);
+        std::sort(mvKeysCell.begin(), mvKeysCell.end(), CompareResponse);
+    }
+    else{
+        int block_size = 3;
+        double quality_level = 0.005;
+        mvCornersCell.clear();
+        cv::goodFeaturesToTrack(im, mvCornersCell, 4 * quota, quality_level, mfMinDistance, cv::noArray(), block_size, true, 0.04);
+        for(size_t i = 0, iend = mvCornersCell.size(); i < iend; i++)
+            mvKeysCell.push_back(cv::KeyPoint(mvCornersCell[i], 0));  // sorted by quality
+    }
+
+    // the strongest corners in the free part of the cell, at least mfMinDistance apart
+    const size_t nBegin = vNewPts.size();
+    const float minDistance2 = mfMinDistance * mfMinDistance;
+    for(size_t i = 0, iend = mvKeysCell.size(); i < iend && int(vNewPts.size() - nBegin) < quota; i++){
+        const cv::Point2f pt = mvKeysCell[i].pt + offset;
+        if(!cell.contains(cv::Point(pt)) || occupancy.IsOccupied(pt))
+            continue;
+
+        bool bNear = false;
+        for(size_t j = nBegin; j < vNewPts.size() && !bNear; j++){
+            const cv::Point2f d = vNewPts[j] - pt;
+            bNear = d.x * d.x + d.y * d.y < minDistance2;
+        }
+        if(!bNear)
+            vNewPts.push_back(pt);
+    }
+}
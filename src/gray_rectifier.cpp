@@ -0,0 +1,59 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gray_rectifier.h"
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "trace.h"
+
+void GrayRectifier::Rectify(const cv::Mat &im, const cv::Mat &map1, const cv::Mat &map2, cv::Mat &gray)
+{
+    TRACE_SCOPE("GrayRectifier::Rectify");
+    gray.create(map1.size(), CV_8UC1);
+
+    // OpenCV runs the remap and the cvtColor of a band serially, they are nested in this parallel region
+    const int nBands = (gray.rows + BAND_ROWS - 1) / BAND_ROWS;
+    cv::parallel_for_(cv::Range(0, nBands), [&](const cv::Range& bands){
+        RectifyRows(im, map1, map2, gray, bands.start * BAND_ROWS, std::min(bands.end * BAND_ROWS, gray.rows));
+    });
+}
+
+void GrayRectifier::RectifyRows(const cv::Mat &im, const cv::Mat &map1, const cv::Mat &map2, cv::Mat &gray,
+                                int rowBegin, int rowEnd)
+{
+    TRACE_SCOPE("GrayRectifier::RectifyRows");
+    static thread_local cv::Mat tile;   // remapped color band, reused by the frames
+
+    for(int r = rowBegin; r < rowEnd; r += BAND_ROWS){
+        const int r1 = std::min(r + BAND_ROWS, rowEnd);
+        const cv::Mat map1Band = map1.rowRange(r, r1), map2Band = map2.rowRange(r, r1);
+        cv::Mat grayBand = gray.rowRange(r, r1);
+
+        // the maps hold absolute source coordinates, so a band of the maps remaps a band of the output
+        if(im.channels() == 1){
+            cv::remap(im, grayBand, map1Band, map2Band, cv::INTER_LINEAR);
+            continue;
+        }
+        cv::remap(im, tile, map1Band, map2Band, cv::INTER_LINEAR);
+        cv::cvtColor(tile, grayBand, im.channels() == 3? cv::COLOR_RGB2GRAY: cv::COLOR_RGBA2GRAY);
+    }
+}
@@ -1,6 +1,11 @@
 #include "gyro_aided_tracker.h"
 #include "patch_match.h"
-#include <stack>
+#include "thread_pool.h"
+#include "result_sink.h"
+#include "trace.h"
+#include "metrics.h"
+#include "stage_scope.h"
+#include "frame_arena.h"
 #include <thread>
 #include <time.h>
 
@@ -8,6 +13,42 @@ const float GyroAidedTracker::TH_NCC_HIGH = 0.6f; //0.85f;
 const float GyroAidedTracker::TH_NCC_LOW = 0.3f; // 0.65f;
 const float GyroAidedTracker::TH_RATIO = 0.75f;
 
+namespace {
+
+// Process wide statistics of the tracker, registered once and updated lock-free
+struct sTrackerMetrics
+{
+    sTrackerMetrics()
+    {
+        MetricsRegistry* pRegistry = MetricsRegistry::GetInstance();
+        pTimeGyroPredict = pRegistry->GetHistogram("tracker_gyro_predict_seconds", "Latency of the gyro-aided prediction", 1e6);
+        pTimeOptFlow = pRegistry->GetHistogram("tracker_optical_flow_seconds", "Latency of the optical flow refinement", 1e6);
+        pTimeFilterOut = pRegistry->GetHistogram("tracker_filter_out_seconds", "Latency of filtering out the optical flow results", 1e6);
+        pTimeGeometryValidation = pRegistry->GetHistogram("tracker_geometry_validation_seconds", "Latency of the geometry validation", 1e6);
+        pTimeTotal = pRegistry->GetHistogram("tracker_total_seconds", "Latency of the feature tracking", 1e6);
+        pRGT = pRegistry->GetHistogram("tracker_rgt_ratio", "Geometry valid tracks over the reference keypoints (RGT)", 1e4);
+        pRGP = pRegistry->GetHistogram("tracker_rgp_ratio", "Geometry valid tracks over the predicted keypoints (RGP)", 1e4);
+        pRecall = pRegistry->GetHistogram("tracker_recall_ratio", "Predicted keypoints over the reference keypoints", 1e4);
+        pImuNum = pRegistry->GetHistogram("tracker_imu_samples", "IMU samples per frame", 1);
+        pFrames = pRegistry->GetCounter("tracker_frames_total", "Frames passed to the geometry validation");
+        pKeysRef = pRegistry->GetCounter("tracker_reference_keypoints_total", "Reference keypoints");
+        pKeysTracked = pRegistry->GetCounter("tracker_tracked_keypoints_total", "Geometry valid tracks");
+        pOutliers = pRegistry->GetCounter("tracker_outliers_total", "Tracks rejected by the geometry validation");
+    }
+
+    Histogram *pTimeGyroPredict, *pTimeOptFlow, *pTimeFilterOut, *pTimeGeometryValidation, *pTimeTotal;
+    Histogram *pRGT, *pRGP, *pRecall, *pImuNum;
+    Counter *pFrames, *pKeysRef, *pKeysTracked, *pOutliers;
+};
+
+sTrackerMetrics& GetTrackerMetrics()
+{
+    static sTrackerMetrics metrics;
+    return metrics;
+}
+
+} // namespace
+
 GyroAidedTracker::GyroAidedTracker(double t, double t_ref, const cv::Mat &imgGrayRef_, const cv::Mat &imgGrayCur_,
                                    const std::vector<cv::KeyPoint> &vKeysRef_, const std::vector<cv::KeyPoint> &vKeysCur_,
                                    const std::vector<cv::KeyPoint> &vKeysUnRef_, const std::vector<cv::KeyPoint> &vKeysUnCur_,
@@ -50,14 +91,9 @@ GyroAidedTracker::GyroAidedTracker(const Frame& pFrameRef, const Frame& pFrameCu
 
 void GyroAidedTracker::Initialize()
 {
-    // create folder
-    if (mSaveFolderPath.size() > 0){    // if the folder path is set, then we save processing results
-        //mSaveFolderPath = mSaveFolderPath + "/mType_" + std::to_string(mType) + "_mPredictMethod_" + std::to_string(mPredictMethod) + "/";
-        std::string command = "mkdir -p " + mSaveFolderPath;
-        int a = system(command.c_str());
-    }
-
+    STAGE_SCOPE("tracker_initialize");
     mbNCC = true;
+    mpResultSink = ResultSink::Get(mSaveFolderPath);
     mHalfPatchSize = mHalfPatchSize == 0? 5: mHalfPatchSize;
     mRadiusForFindNearNeighbor = 2 * mHalfPatchSize; //4.0f;
 
@@ -74,40 +110,38 @@ void GyroAidedTracker::Initialize()
     mvPatchCorners[1] = cv::Point2f(mHalfPatchSize, - mHalfPatchSize);  // top right
     mvPatchCorners[2] = cv::Point2f(- mHalfPatchSize, mHalfPatchSize);  // bottom left
     mvPatchCorners[3] = cv::Point2f(mHalfPatchSize, mHalfPatchSize);    // botton right
-    mMatPatchCorners = cv::Mat(mvPatchCorners).reshape(1).t();    // matB is used for predicting the affine deformation matrix
 
     mN = mvKeysRef.size();
 
     mvPtPredict = std::vector<cv::Point2f>(mN, cv::Point2f(0,0));
     mvPtPredictUn = std::vector<cv::Point2f>(mN, cv::Point2f(0,0));
-    mvFlowsPredictUn = std::vector<cv::Point2f>(mN, cv::Point2f(0,0));
     mvStatus = std::vector<uchar>(mN, false);
     mvError.resize(mvKeysRef.size());
     mvDisparities.reserve(mN);
     mvMatches.reserve(mN);
     mvvNearNeighbors.resize(mN);
 
-    // corners of the predict pixels
-    mvvPtPredictCorners.resize(mN);
-    mvvPtPredictCornersUn.resize(mN);
-    mvvFlowsPredictCorners.resize(mN);
-    mvAffineDeformationMatrix.resize(mN);
+    mFeatures.Resize(mN);
+    mFeatures.SetReference(mvKeysRefUn);
 }
 
-void GyroAidedTracker::SetBackToFrame(Frame &pFrame)
+GyroAidedTracker::sResultsView GyroAidedTracker::GetResults() const
 {
-    pFrame.mvPtGyroPredictUn = std::vector<cv::Point2f>(mvPtGyroPredictUn.begin(), mvPtGyroPredictUn.end());
-    pFrame.mvPtPredict = std::vector<cv::Point2f>(mvPtPredict.begin(), mvPtPredict.end());
-    pFrame.mvPtPredictUn = std::vector<cv::Point2f>(mvPtPredictUn.begin(), mvPtPredictUn.end());
-    pFrame.mvStatus = std::vector<uchar>(mvStatus.begin(), mvStatus.end());
-    pFrame.mvNcc = std::vector<float>(mvNccAfterPatchMatched.begin(), mvNccAfterPatchMatched.end());
-
-    pFrame.mvvFlowsPredictCorners.resize(mvvFlowsPredictCorners.size());
-    for(size_t i = 0, iend = mvvFlowsPredictCorners.size(); i < iend; i++){
-        pFrame.mvvFlowsPredictCorners[i] = std::vector<cv::Point2f>(mvvFlowsPredictCorners[i].begin(), mvvFlowsPredictCorners[i].end());
-    }
+    sResultsView view = {mvPtPredict, mvPtPredictUn, mvPtGyroPredictUn, mvStatus, mvStatusWithoutGeometryValid,
+                         mFeatures, mRcl};
+    return view;
+}
 
-    pFrame.mRcl = mRcl.clone();
+void GyroAidedTracker::MoveResultsToFrame(Frame &pFrame)
+{
+    STAGE_SCOPE("move_results_to_frame");
+    pFrame.mvPtGyroPredictUn.swap(mvPtGyroPredictUn);
+    pFrame.mvPtPredict.swap(mvPtPredict);
+    pFrame.mvPtPredictUn.swap(mvPtPredictUn);
+    pFrame.mvStatus.swap(mvStatus);
+    pFrame.mvStatusWithoutGeometryValid.swap(mvStatusWithoutGeometryValid);
+    pFrame.mTracks.swap(mFeatures);
+    pFrame.mRcl = mRcl;     // reference counted
 }
 
 /**
@@ -117,11 +151,18 @@ void GyroAidedTracker::SetBackToFrame(Frame &pFrame)
  */
 int GyroAidedTracker::GyroPredictFeatures()
 {
+    TRACE_SCOPE("GyroPredictFeatures");
     std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
-    cv::parallel_for_(cv::Range(0,mN), [&](const cv::Range& range){
+    FeatureTable &f = mFeatures;
+    const float inv4h2 = 1.0f / (4.0f * mHalfPatchSize * mHalfPatchSize);
+
+    // Split the features in blocks, so that each thread owns its words of f.predicted
+    cv::parallel_for_(cv::Range(0,f.NumBlocks()), [&](const cv::Range& blocks){
+        STAGE_SCOPE("gyro_predict");
+        const cv::Range range = f.BlockToFeatures(blocks);
         for (auto i = range.start; i < range.end; i++){
-            cv::Point2f pt_ref_un = mvKeysRefUn[i].pt;
+            cv::Point2f pt_ref_un(f.uRef[i], f.vRef[i]);
             cv::Point2f pt_predict_un;
             cv::Point2f pt_predict_distort;
             cv::Point2f flow;
@@ -134,52 +175,48 @@ int GyroAidedTracker::GyroPredictFeatures()
             if (pt_predict_distort.x < 0 || pt_predict_distort.x >= mWidth || pt_predict_distort.y < 0 || pt_predict_distort.y >= mHeight)
                 continue;
 
-            mvPtPredictUn[i] = pt_predict_un;
-            mvPtPredict[i] = pt_predict_distort; // Distorted
-            mvStatus[i] = true;
-            mvFlowsPredictUn[i] = flow;
-
-            // Predict four corners on undistorted image
-            std::vector<cv::Point2f> vPtPredictCorners;
-            std::vector<cv::Point2f> vPtPredictCornesUn;
-            std::vector<cv::Point2f> vecC;  // predicted corner - center point
+            f.uPredUn[i] = pt_predict_un.x; f.vPredUn[i] = pt_predict_un.y;
+            f.uPred[i] = pt_predict_distort.x; f.vPred[i] = pt_predict_distort.y; // Distorted
+            f.uFlow[i] = flow.x; f.vFlow[i] = flow.y;
+            f.predicted.Set(i);
 
-            // Predict the four corners of the patch window
-            for (int j = 0; j < mvPatchCorners.size(); j++) {
-                cv::Point2f pt_corner_un(mvKeysRefUn[i].pt + mvPatchCorners[j]);
+            // Predict the four corners of the patch window on undistorted image,
+            // and accumulate C * P^T, where C are the predicted corners - center point and P the patch corners.
+            float cp11 = 0, cp12 = 0, cp21 = 0, cp22 = 0;
+            for (int j = 0; j < FeatureTable::CORNERS; j++) {
+                cv::Point2f pt_corner_un(pt_ref_un + mvPatchCorners[j]);
 
                 cv::Point2f pt_predict_corner_un;
                 cv::Point2f pt_predict_corner_distort;
                 cv::Point2f flow_corner;
                 GyroPredictOnePixel(pt_corner_un, pt_predict_corner_un, pt_predict_corner_distort, flow_corner);
-                vPtPredictCornesUn.push_back(pt_predict_corner_un);
-                vPtPredictCorners.push_back(pt_predict_corner_distort);
 
-                // Since the affine matrix is applied on raw image, we use the distorted corners to estimate the matrix.
-                vecC.push_back(pt_predict_corner_un - pt_predict_un);
+                cv::Point2f vecC = pt_predict_corner_un - pt_predict_un;
+                f.uCorner[j][i] = vecC.x;
+                f.vCorner[j][i] = vecC.y;
+
+                cp11 += vecC.x * mvPatchCorners[j].x; cp12 += vecC.x * mvPatchCorners[j].y;
+                cp21 += vecC.y * mvPatchCorners[j].x; cp22 += vecC.y * mvPatchCorners[j].y;
             }
-            mvvPtPredictCorners[i] = vPtPredictCorners;
-            mvvPtPredictCornersUn[i] = vPtPredictCornesUn;
-            mvvFlowsPredictCorners[i] = vecC;
 
             // Predict the affine deformation matrix A. A = [1 + dxx, dxy; dyx, 1 + dyy]. Note: on undistort image
-            cv::Mat matC = cv::Mat(vecC).reshape(1).t();
-            cv::Mat A = matC * mMatPatchCorners.t() * (mMatPatchCorners * mMatPatchCorners.t()).inv();
-            mvAffineDeformationMatrix[i] = A;   // The affine matrix is applied on raw image
+            // A = C * P^T * (P * P^T)^-1, and P * P^T = 4 * h^2 * I for the square patch window.
+            f.a11[i] = cp11 * inv4h2; f.a12[i] = cp12 * inv4h2;
+            f.a21[i] = cp21 * inv4h2; f.a22[i] = cp22 * inv4h2;
         }
     });
 
-    int n_predict = 0;
-    for (auto state: mvStatus){
-        if (state)
-            n_predict ++;
-    }
+    int n_predict = f.predicted.Count();
 
     std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
     mTimeCostGyroPredict = std::chrono::duration_cast<std::chrono::duration<float> >(t2 - t1).count();
 
-    mvPtGyroPredict = std::vector<cv::Point2f>(mvPtPredict.begin(), mvPtPredict.end());
-    mvPtGyroPredictUn = std::vector<cv::Point2f>(mvPtPredictUn.begin(), mvPtPredictUn.end());
+    f.uGyroUn = f.uPredUn;
+    f.vGyroUn = f.vPredUn;
+
+    f.GetPredicted(mvPtPredict, mvPtPredictUn);
+    f.GetGyroPredictedUn(mvPtGyroPredictUn);
+    f.GetStatus(f.predicted, mvStatus);
 
     return n_predict;
 }
@@ -261,12 +298,11 @@ int GyroAidedTracker::GyroPredictFeaturesAndOpticalFlowRefined()
     if (mbHasGyroPredictInitial)
         int n_predict_gyro = GyroPredictFeatures();     // default: true
     else {
+        // The flows are zero and the affine matrices identity after FeatureTable::Resize()
         for (int i = 0; i < mN; i++){
-            mvPtPredictUn[i] = mvKeysRefUn[i].pt;
-            mvPtPredict[i] = mvKeysRef[i].pt;
-            mvStatus[i] = true;
-            mvFlowsPredictUn[i] = cv::Point2f(0,0);
-            mvAffineDeformationMatrix[i] = cv::Mat::eye(2,2,CV_32F);
+            mFeatures.uPredUn[i] = mvKeysRefUn[i].pt.x; mFeatures.vPredUn[i] = mvKeysRefUn[i].pt.y;
+            mFeatures.uPred[i] = mvKeysRef[i].pt.x; mFeatures.vPred[i] = mvKeysRef[i].pt.y;
+            mFeatures.predicted.Set(i);
         }
     }
 
@@ -289,14 +325,17 @@ int GyroAidedTracker::GyroPredictFeaturesAndOpticalFlowRefined()
     /// Step 3: Set patch matched results back to mvPredict and mvPredictUn.
     /// Step 3.1: Set thresholds for filtering out patch-matched refined pixels.
     std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
-    int N = mvKeysRefUn.size();
+    TRACE_SCOPE("OptFlowResultFilterOut");
+    STAGE_SCOPE("filter_out");
+    FeatureTable &f = mFeatures;
+    int N = f.size();
 
     double sumPixelError = 0;
     double maxPixelError = 0;
     int cnt = 0;
     for (int i = 0; i < N; ++i) {
-        if (mvStatusAfterPatchMatched[i]) {
-            double pixelError = mvPixelErrorsOfPatchMatched[i];
+        if (f.matched.Test(i)) {
+            double pixelError = f.error[i];
             maxPixelError = maxPixelError < pixelError? pixelError : maxPixelError;
             sumPixelError += pixelError;
             cnt ++;
@@ -311,30 +350,33 @@ int GyroAidedTracker::GyroPredictFeaturesAndOpticalFlowRefined()
     //             that have large distance between gyro. predict results and patch-matched results.
     double thDistance = mHalfPatchSize * 4.0;
 
-    /// Step 3.2: Filter out and set back to mvPredict, mvPtPredictUn, and mvStatus.
+    /// Step 3.2: Filter out and set back to the predicted pixels and the tracked flags.
     maxPixelError = 0;
     double maxDist = 0, sumDist = 0;
     int n_predict = 0;
+    f.tracked.Clear();
     for (size_t i = 0; i < N; i++) {
-        double pixelError = mvPixelErrorsOfPatchMatched[i];
-        double distance = mvDistanceBetweenPredictedAndPatchMatched[i];
+        double pixelError = f.error[i];
+        float du = f.uPredUn[i] - f.uMatchUn[i], dv = f.vPredUn[i] - f.vMatchUn[i];
+        double distance = std::sqrt(du * du + dv * dv);
 
-        if (mvStatusAfterPatchMatched[i] && pixelError < thPixelError && distance < thDistance) {
+        if (f.matched.Test(i) && pixelError < thPixelError && distance < thDistance) {
             sumDist += distance;
 
             maxPixelError = maxPixelError < pixelError? pixelError : maxPixelError;
             maxDist = maxDist < distance? distance : maxDist;
 
-            // Set back to mvPredict, mvPtPredictUn, and mvStatus
-            mvPtPredict[i] = mvPtPredictAfterPatchMatched[i];
-            mvPtPredictUn[i] = mvPtPredictAfterPatchMatchedUn[i];
-            mvStatus[i] = true;
+            // Set back to the predicted pixels
+            f.uPred[i] = f.uMatch[i]; f.vPred[i] = f.vMatch[i];
+            f.uPredUn[i] = f.uMatchUn[i]; f.vPredUn[i] = f.vMatchUn[i];
+            f.tracked.Set(i);
             n_predict ++;
-        }else {
-            mvStatus[i] = false;
         }
     }
 
+    f.GetPredicted(mvPtPredict, mvPtPredictUn);
+    f.GetStatus(f.tracked, mvStatus);
+
     std::chrono::steady_clock::time_point t4 = std::chrono::steady_clock::now();
     mTimeCostOptFlowResultFilterOut = std::chrono::duration_cast<std::chrono::duration<float> >(t4 - t3).count();
 
@@ -344,7 +386,8 @@ int GyroAidedTracker::GyroPredictFeaturesAndOpticalFlowRefined()
 int GyroAidedTracker::TrackFeatures()
 {
     Timer timer, timer_total;
-    IntegrateGyroMeasurements();
+    if(!mbHasPredictedRcl)
+        IntegrateGyroMeasurements();
     double t_integrate = timer.runTime_s(); timer.freshTimer();
 
     int n_predict;
@@ -372,7 +415,8 @@ int GyroAidedTracker::TrackFeatures()
             if(mvError[i] >= 12.0)
                 mvStatus[i] = false;
 
-            mvFlowsPredictUn[i] = mvPtPredictUn[i] - mvKeysRefUn[i].pt;
+            mFeatures.uFlow[i] = mvPtPredictUn[i].x - mvKeysRefUn[i].pt.x;
+            mFeatures.vFlow[i] = mvPtPredictUn[i].y - mvKeysRefUn[i].pt.y;
         }
 
         // distort points for display
@@ -428,9 +472,13 @@ int GyroAidedTracker::TrackFeatures()
 // Step 2: use multi-view geometric to filter out outliers
 int GyroAidedTracker::GeometryValidation()
 {
+    TRACE_SCOPE("GeometryValidation");
+    STAGE_SCOPE("geometry_validation");
+    mvStatusWithoutGeometryValid = mvStatus;    // kept for display
     Timer timer;
-    std::vector<cv::Point2f> vPts1, vPts2;
-std:vector<int> vIndeces;
+    ArenaVector<cv::Point2f> vPts1, vPts2;
+    ArenaVector<int> vIndeces;
+    vPts1.reserve(mN); vPts2.reserve(mN); vIndeces.reserve(mN);
     for(size_t i = 0, iend = mvKeysRefUn.size(); i < iend; i++){
         if(mvStatus[i]){
             vIndeces.push_back(i);
@@ -442,36 +490,63 @@ std:vector<int> vIndeces;
     // Perform geometrical validation to filter out outliers
     int cnt_inlier = 0, cnt_outlier = 0;
     float track_score = 0;
-    if(vPts1.size() > 8)
+    bool bValidByGyroPrior = false;
+    if(mGeometryValidation == GYRO_PRIOR_TWO_POINT && vPts1.size() > 2 && !mRcl.empty())
+    {
+        float sigma = 1.0;
+        cv::Mat t21;
+        BitMask vbInliers;
+        bValidByGyroPrior = CheckGyroPriorTranslation(t21, track_score, vbInliers, vPts1, vPts2, sigma);
+        if(bValidByGyroPrior){
+            for (size_t i = 0, iend = vIndeces.size(); i < iend; i++) {
+                if(!vbInliers.Test(i)){
+                    mvStatus[vIndeces[i]] = false;  // mark outliers
+                    cnt_outlier ++;
+                }
+                else {
+                    cnt_inlier ++;
+                }
+            }
+        }
+    }
+
+    if(!bValidByGyroPrior && vPts1.size() > 8)
     {
         float sigma = 1.0;
         float score_F, score_H;
-        std::vector<bool> vbMatchesInliers_F;
-        std::vector<bool> vbMatchesInliers_H;
+        BitMask vbMatchesInliers_F;
+        BitMask vbMatchesInliers_H;
         cv::Mat F21, H21;
 
-        std::thread threadH(&GyroAidedTracker::CheckHomography, this, std::ref(H21), std::ref(score_H), ref(vbMatchesInliers_H), ref(vPts1), ref(vPts2), ref(sigma));
-        std::thread threadF(&GyroAidedTracker::CheckFundamental, this, std::ref(F21),std::ref(score_F), ref(vbMatchesInliers_F), ref(vPts1), ref(vPts2), ref(sigma));
+        sPointsSoA pts;
+        pts.Set(vPts1, vPts2);
+        const cv::Mat matPts1(vPts1.size(), 1, CV_32FC2, vPts1.data());
+        const cv::Mat matPts2(vPts2.size(), 1, CV_32FC2, vPts2.data());
+
+        // Score the homography on the persistent pool, and the fundamental matrix on this thread meanwhile.
+        // The stage is thread-local, open it on the worker (not when the task runs inline in this scope).
+        ThreadPool* pPool = ThreadPool::GetInstance();
+        const bool bInline = pPool->IsWorkerThread();
+        std::future<void> futureH = pPool->Enqueue([&, bInline](){
+            if(bInline){
+                CheckHomography(H21, score_H, vbMatchesInliers_H, matPts1, matPts2, pts, sigma);
+                return;
+            }
+            STAGE_SCOPE("geometry_validation");
+            CheckHomography(H21, score_H, vbMatchesInliers_H, matPts1, matPts2, pts, sigma);
+        });
+        CheckFundamental(F21, score_F, vbMatchesInliers_F, matPts1, matPts2, pts, sigma);
 
-        // Wait until both threads have finished
-        threadH.join();
-        threadF.join();
+        // Wait until both have finished
+        futureH.get();
 
         float RH = score_H / (score_F + score_H);
-        std::vector<bool> vbInliers;
         // Choose homography model or fundamental to remove outliers depending on ratio (0.40~0.45)
-        if(RH > 0.45){
-            vbInliers = vbMatchesInliers_H; // choose H
-            track_score = score_H;
-        }
-        else{
-            vbInliers = vbMatchesInliers_F; // choose F
-            track_score = score_F;
-        }
-
+        const BitMask &vbInliers = RH > 0.45? vbMatchesInliers_H: vbMatchesInliers_F;
+        track_score = RH > 0.45? score_H: score_F;
 
         for (size_t i = 0, iend = vIndeces.size(); i < iend; i++) {
-            if(!vbInliers[i]){
+            if(!vbInliers.Test(i)){
                 mvStatus[vIndeces[i]] = false;  // mark outliers
                 cnt_outlier ++;
             }
@@ -484,25 +559,36 @@ std:vector<int> vIndeces;
     mTimeCostGeometryValidation = timer.runTime_s(); timer.freshTimer();
     mTImeCostTotalFeatureTrack = mTimeCostGyroPredict + mTimeCostOptFlow + mTimeCostOptFlowResultFilterOut + mTimeCostGeometryValidation;
 
-    std::stringstream s1;
-    s1 << "RefKey Num: " << mN << ", patchMatchPredict Num: " << vPts1.size()
-       << ", Geo. valid: " << cnt_inlier
-       << ", Pred. suc. rate: " << 100.0 * cnt_inlier / vPts1.size() << "%"
-       << ", feature track rate: " << 100.0 * cnt_inlier / mN << "%"
-       << ", IMU num: " << mvImuFromLastFrame.size()
-       << ", track_score: " << track_score
-       << ", recall rate: " << 100.0 * vPts1.size() / mN << "%"; // << std::endl;
-    std::string msg1 = "T: " + std::to_string(mTimeStamp) + ", " + s1.str();
-    SaveMsgToFile("trackFeatures.txt", msg1);
-
-    std::stringstream s2;
-    s2  << "Total FeatureTrack: " << mTImeCostTotalFeatureTrack
-        << ", GyroPredict: " << mTimeCostGyroPredict
-        << ", OptFlow: " << mTimeCostOptFlow
-        << ", OptFlowResultFilterOut: " << mTimeCostOptFlowResultFilterOut
-        << ", GeometryValidation: " << mTimeCostGeometryValidation;// << std::endl;
-    std::string msg2 = "T: " + std::to_string(mTimeStamp) + ", " + s2.str();
-    SaveMsgToFile("timeCost.txt", msg2);
+    // save results to files, formatted and written by the background thread of the sink
+    if(mpResultSink){
+        const float nPredict = vPts1.size();
+        const float vTrack[8] = {float(mN), nPredict, float(cnt_inlier),
+                                 100.0f * cnt_inlier / nPredict, 100.0f * cnt_inlier / mN,
+                                 float(mvImuFromLastFrame.size()), track_score, 100.0f * nPredict / mN};
+        mpResultSink->Push(ResultSink::TRACK_FEATURES, mTimeStamp, vTrack, 8);
+
+        const float vTime[5] = {mTImeCostTotalFeatureTrack, mTimeCostGyroPredict, mTimeCostOptFlow,
+                                mTimeCostOptFlowResultFilterOut, mTimeCostGeometryValidation};
+        mpResultSink->Push(ResultSink::TIME_COST, mTimeStamp, vTime, 5);
+    }
+
+    sTrackerMetrics &metrics = GetTrackerMetrics();
+    metrics.pTimeGyroPredict->Record(mTimeCostGyroPredict);
+    metrics.pTimeOptFlow->Record(mTimeCostOptFlow);
+    metrics.pTimeFilterOut->Record(mTimeCostOptFlowResultFilterOut);
+    metrics.pTimeGeometryValidation->Record(mTimeCostGeometryValidation);
+    metrics.pTimeTotal->Record(mTImeCostTotalFeatureTrack);
+    if(mN > 0){
+        metrics.pRGT->Record(float(cnt_inlier) / mN);
+        metrics.pRecall->Record(float(vPts1.size()) / mN);
+    }
+    if(!vPts1.empty())
+        metrics.pRGP->Record(float(cnt_inlier) / vPts1.size());
+    metrics.pImuNum->Record(mvImuFromLastFrame.size());
+    metrics.pFrames->Add();
+    metrics.pKeysRef->Add(mN);
+    metrics.pKeysTracked->Add(cnt_inlier);
+    metrics.pOutliers->Add(cnt_outlier);
 
     return cnt_inlier;
 }
@@ -518,8 +604,15 @@ void GyroAidedTracker::SetRcl(const cv::Mat Rcl_)
     mKRKinv = mK * mRcl * mK.inv();
 }
 
+void GyroAidedTracker::SetPredictedRcl(const cv::Mat Rcl_)
+{
+    SetRcl(Rcl_);
+    mbHasPredictedRcl = true;
+}
+
 void GyroAidedTracker::IntegrateGyroMeasurements()
 {
+    TRACE_SCOPE("IntegrateGyroMeasurements");
     cv::Mat dR_ref_cur = cv::Mat::eye(3, 3, CV_32F);
     const int n = mvImuFromLastFrame.size()-1;
 
@@ -586,139 +679,155 @@ cv::Mat GyroAidedTracker::IntegrateOneGyroMeasurement(cv::Point3f &gyro, double
     return deltaR;
 }
 
+void GyroAidedTracker::sPointsSoA::Set(const ArenaVector<cv::Point2f> &vPts1, const ArenaVector<cv::Point2f> &vPts2)
+{
+    const size_t N = vPts1.size();
+    u1.resize(N); v1.resize(N); u2.resize(N); v2.resize(N);
+    for(size_t i = 0; i < N; i++){
+        u1[i] = vPts1[i].x; v1[i] = vPts1[i].y;
+        u2[i] = vPts2[i].x; v2[i] = vPts2[i].y;
+    }
+}
+
+/**
+ * The scoring loops of CheckHomography() and CheckFundamental() are split in two passes:
+ * the first one computes the chi-square errors over the SoA buffers without branches (auto vectorized),
+ * the second one accumulates the score and packs the inlier mask.
+ */
+static float ScoreSymmetricErrors(const ArenaVector<float> &vChiSquare1, const ArenaVector<float> &vChiSquare2,
+                                  const float th, const float thScore, BitMask &vbMatchesInliers)
+{
+    const size_t N = vChiSquare1.size();
+    vbMatchesInliers.Resize(N);
+
+    float score = 0;
+    for(size_t i = 0; i < N; i++){
+        const float chiSquare1 = vChiSquare1[i], chiSquare2 = vChiSquare2[i];
+        const bool bIn1 = chiSquare1 <= th, bIn2 = chiSquare2 <= th;
+        score += (bIn2? thScore - chiSquare2: 0.0f) + (bIn1? thScore - chiSquare1: 0.0f);
+        if(bIn1 && bIn2)
+            vbMatchesInliers.Set(i);
+    }
+    return score;
+}
+
 float GyroAidedTracker::CheckHomography(
         cv::Mat &H21,
         float &score,
-        std::vector<bool> &vbMatchesInliers,
-        std::vector<cv::Point2f> &vPts1, std::vector<cv::Point2f> &vPts2,
+        BitMask &vbMatchesInliers,
+        const cv::Mat &matPts1, const cv::Mat &matPts2,
+        const sPointsSoA &pts,
         float sigma)
 {
+    TRACE_SCOPE("CheckHomography");
+    ArenaScope scope;   // may run on a ThreadPool worker, whose arena is only rewound by the scopes
+    const int N = pts.size();
+    score = 0;
+
     cv::Mat mask;
-    H21 =  cv::findHomography(vPts1, vPts2, cv::RANSAC, 3, mask);
+    H21 =  cv::findHomography(matPts1, matPts2, cv::RANSAC, 3, mask);
+    if(H21.empty()){
+        vbMatchesInliers.Resize(N);
+        return score;
+    }
     cv::Mat H12 = H21.inv();
 
-    const double h11 = H21.at<double>(0,0);
-    const double h12 = H21.at<double>(0,1);
-    const double h13 = H21.at<double>(0,2);
-    const double h21 = H21.at<double>(1,0);
-    const double h22 = H21.at<double>(1,1);
-    const double h23 = H21.at<double>(1,2);
-    const double h31 = H21.at<double>(2,0);
-    const double h32 = H21.at<double>(2,1);
-    const double h33 = H21.at<double>(2,2);
-
-    const double h11inv = H12.at<double>(0,0);
-    const double h12inv = H12.at<double>(0,1);
-    const double h13inv = H12.at<double>(0,2);
-    const double h21inv = H12.at<double>(1,0);
-    const double h22inv = H12.at<double>(1,1);
-    const double h23inv = H12.at<double>(1,2);
-    const double h31inv = H12.at<double>(2,0);
-    const double h32inv = H12.at<double>(2,1);
-    const double h33inv = H12.at<double>(2,2);
-
-    const int N = vPts1.size();
-    vbMatchesInliers.resize(N);
+    const float h11 = H21.at<double>(0,0);
+    const float h12 = H21.at<double>(0,1);
+    const float h13 = H21.at<double>(0,2);
+    const float h21 = H21.at<double>(1,0);
+    const float h22 = H21.at<double>(1,1);
+    const float h23 = H21.at<double>(1,2);
+    const float h31 = H21.at<double>(2,0);
+    const float h32 = H21.at<double>(2,1);
+    const float h33 = H21.at<double>(2,2);
+
+    const float h11inv = H12.at<double>(0,0);
+    const float h12inv = H12.at<double>(0,1);
+    const float h13inv = H12.at<double>(0,2);
+    const float h21inv = H12.at<double>(1,0);
+    const float h22inv = H12.at<double>(1,1);
+    const float h23inv = H12.at<double>(1,2);
+    const float h31inv = H12.at<double>(2,0);
+    const float h32inv = H12.at<double>(2,1);
+    const float h33inv = H12.at<double>(2,2);
 
-    score = 0;
     const float th = 5.99;
     const float invSigmaSquare = 1.0/(sigma*sigma);
 
-    int cnt_outlier = 0;
-    int cnt_sum = 0;
-    for(size_t i = 0; i < N; i++){
-        bool bIn = true;
-        const cv::Point2f &pt1 = vPts1[i];
-        const cv::Point2f &pt2 = vPts2[i];
-
-        const float u1 = pt1.x;
-        const float v1 = pt1.y;
-        const float u2 = pt2.x;
-        const float v2 = pt2.y;
+    const float *pu1 = pts.u1.data(), *pv1 = pts.v1.data();
+    const float *pu2 = pts.u2.data(), *pv2 = pts.v2.data();
+    ArenaVector<float> vChiSquare1(N), vChiSquare2(N);
+    float *pChiSquare1 = vChiSquare1.data(), *pChiSquare2 = vChiSquare2.data();
+    for(int i = 0; i < N; i++){
+        const float u1 = pu1[i];
+        const float v1 = pv1[i];
+        const float u2 = pu2[i];
+        const float v2 = pv2[i];
 
         // Reprojection error in second image
         // x2 = H21 * x1
-        const float w1in2inv = 1.0 / (h31 * u1 + h32 * v1 + h33);
+        const float w1in2inv = 1.0f / (h31 * u1 + h32 * v1 + h33);
         const float u1in2 = (h11 * u1 + h12 * v1 + h13) * w1in2inv;
         const float v1in2 = (h21 * u1 + h22 * v1 + h23) * w1in2inv;
-
-        const float squareDist2 = (u2 - u1in2) * (u2 - u1in2) + (v2 - v1in2) * (v2 - v1in2);
-        const float chiSquare2 = squareDist2 * invSigmaSquare;
-
-        if(chiSquare2 > th)
-            bIn = false;
-        else{
-            score += th - chiSquare2;
-            cnt_sum ++;
-        }
+        pChiSquare2[i] = ((u2 - u1in2) * (u2 - u1in2) + (v2 - v1in2) * (v2 - v1in2)) * invSigmaSquare;
 
         // Reprojection error in the first image
         // x1 = H12 * x2
-        const float w2in1inv = 1.0 / (h31inv * u2 + h32inv * v2 + h33inv);
+        const float w2in1inv = 1.0f / (h31inv * u2 + h32inv * v2 + h33inv);
         const float u2in1 = (h11inv * u2 + h12inv * v2 + h13inv) * w2in1inv;
         const float v2in1 = (h21inv * u2 + h22inv * v2 + h23inv) * w2in1inv;
-
-        const float squareDist1 = (u1 - u2in1) * (u1 - u2in1) + (v1 - v2in1) * (v1 - v2in1);
-        const float chiSquare1 = squareDist1 * invSigmaSquare;
-
-        if(chiSquare1 > th)
-            bIn = false;
-        else{
-            score += th - chiSquare1;
-            cnt_sum ++;
-        }
-
-        if (bIn)
-            vbMatchesInliers[i] = true;
-        else{
-            vbMatchesInliers[i] = false;
-            cnt_outlier ++;
-        }
+        pChiSquare1[i] = ((u1 - u2in1) * (u1 - u2in1) + (v1 - v2in1) * (v1 - v2in1)) * invSigmaSquare;
     }
 
+    score = ScoreSymmetricErrors(vChiSquare1, vChiSquare2, th, th, vbMatchesInliers);
     return score;
 }
 
 float GyroAidedTracker::CheckFundamental(
         cv::Mat &F21,
         float &score,
-        std::vector<bool> &vbMatchesInliers,
-        std::vector<cv::Point2f> &vPts1,
-        std::vector<cv::Point2f> &vPts2,
+        BitMask &vbMatchesInliers,
+        const cv::Mat &matPts1,
+        const cv::Mat &matPts2,
+        const sPointsSoA &pts,
         float sigma)
 {
+    TRACE_SCOPE("CheckFundamental");
+    ArenaScope scope;
+    const int N = pts.size();
+    score = 0;
+
     cv::Mat mask;
-    F21 = cv::findFundamentalMat(vPts1, vPts2, CV_FM_RANSAC, 3., 0.99, mask);
-
-    const double f11 = F21.at<double>(0,0);
-    const double f12 = F21.at<double>(0,1);
-    const double f13 = F21.at<double>(0,2);
-    const double f21 = F21.at<double>(1,0);
-    const double f22 = F21.at<double>(1,1);
-    const double f23 = F21.at<double>(1,2);
-    const double f31 = F21.at<double>(2,0);
-    const double f32 = F21.at<double>(2,1);
-    const double f33 = F21.at<double>(2,2);
+    F21 = cv::findFundamentalMat(matPts1, matPts2, CV_FM_RANSAC, 3., 0.99, mask);
+    if(F21.empty()){
+        vbMatchesInliers.Resize(N);
+        return score;
+    }
 
-    const int N = vPts1.size();
-    vbMatchesInliers.resize(N);
+    const float f11 = F21.at<double>(0,0);
+    const float f12 = F21.at<double>(0,1);
+    const float f13 = F21.at<double>(0,2);
+    const float f21 = F21.at<double>(1,0);
+    const float f22 = F21.at<double>(1,1);
+    const float f23 = F21.at<double>(1,2);
+    const float f31 = F21.at<double>(2,0);
+    const float f32 = F21.at<double>(2,1);
+    const float f33 = F21.at<double>(2,2);
 
-    score = 0;
     const float th = 3.84;
     const float thScore = 5.99;
     const float invSigmaSquare = 1.0/(sigma*sigma);
 
-    int cnt_outlier = 0;
-    int cnt_sum = 0;
-    for(size_t i = 0; i < N; i++){
-        bool bIn = true;
-        const cv::Point2f &pt1 = vPts1[i];
-        const cv::Point2f &pt2 = vPts2[i];
-
-        const float u1 = pt1.x;
-        const float v1 = pt1.y;
-        const float u2 = pt2.x;
-        const float v2 = pt2.y;
+    const float *pu1 = pts.u1.data(), *pv1 = pts.v1.data();
+    const float *pu2 = pts.u2.data(), *pv2 = pts.v2.data();
+    ArenaVector<float> vChiSquare1(N), vChiSquare2(N);
+    float *pChiSquare1 = vChiSquare1.data(), *pChiSquare2 = vChiSquare2.data();
+    for(int i = 0; i < N; i++){
+        const float u1 = pu1[i];
+        const float v1 = pv1[i];
+        const float u2 = pu2[i];
+        const float v2 = pv2[i];
 
         // Reprojection error in second image
         // l2 = F21 * p1
@@ -728,15 +837,7 @@ float GyroAidedTracker::CheckFundamental(
 
         // square distance of p2 to l2
         const float num2 = a2 * u2 + b2 * v2 + c2;
-        const float squareDist2 = num2 * num2 / (a2 * a2 + b2 * b2);
-        const float chiSquare2 = squareDist2 * invSigmaSquare;
-
-        if(chiSquare2 > th)
-            bIn = false;
-        else{
-            score += thScore - chiSquare2;
-            cnt_sum ++;
-        }
+        pChiSquare2[i] = num2 * num2 / (a2 * a2 + b2 * b2) * invSigmaSquare;
 
         // Reprojection error in first image
         // l1 = p2^T * F21
@@ -746,59 +847,167 @@ float GyroAidedTracker::CheckFundamental(
 
         // square distance of p1 to l1
         const float num1 = a1 * u1 + b1 * v1 + c1;
-        const float squareDist1 = num1 * num1 / (a1 * a1 + b1 * b1);
-        const float chiSquare1 = squareDist1 * invSigmaSquare;
-
-        if (chiSquare1 > th)
-            bIn = false;
-        else{
-            score += thScore - chiSquare1;
-            cnt_sum ++;
-        }
-
-        if (bIn)
-            vbMatchesInliers[i] = true;
-        else{
-            vbMatchesInliers[i] = false;
-            cnt_outlier ++;
-        }
+        pChiSquare1[i] = num1 * num1 / (a1 * a1 + b1 * b1) * invSigmaSquare;
     }
 
+    score = ScoreSymmetricErrors(vChiSquare1, vChiSquare2, th, thScore, vbMatchesInliers);
     return score;
 }
 
-void GyroAidedTracker::SaveMsgToFile(std::string filename, std::string &msg)
+/**
+ * Geometry validation with the gyro prior. Since X2 = Rcl * X1 + t, after de-rotating the reference
+ * ray x1' = Rcl * x1, the epipolar constraint becomes x2^T [t]x x1' = 0, i.e., t^T (x1' x x2) = 0.
+ * Two correspondences determine the translation direction: t = n1 x n2, n = x1' x x2.
+ * When the camera almost only rotates, t is not observable and the pure rotation model (x2 ~ x1') is used.
+ * @brief GyroAidedTracker::CheckGyroPriorTranslation
+ * @param t21   [out] The translation direction (3x1, unit). Zero for pure rotation.
+ * @return false if the gyro prior explains too few tracks (e.g., uncalibrated IMU), then use H/F instead.
+ */
+bool GyroAidedTracker::CheckGyroPriorTranslation(
+        cv::Mat &t21,
+        float &score,
+        BitMask &vbMatchesInliers,
+        const ArenaVector<cv::Point2f> &vPts1,
+        const ArenaVector<cv::Point2f> &vPts2,
+        float sigma)
 {
-    std::ofstream fp(mSaveFolderPath + filename, ofstream::app);
-    if(!fp.is_open()) LOG(ERROR) << RED"cannot open: " << filename << RESET;
-    else {
-        fp << std::fixed << std::setprecision(6);
-        fp << msg << std::endl;
+    TRACE_SCOPE("CheckGyroPriorTranslation");
+    ArenaScope scope;
+    const int N = vPts1.size();
+    const float invSigmaSquare = 1.0/(sigma*sigma);
+    const float thRotation = 5.99;  // pixel error of the pure rotation model, same as CheckHomography
+    const float th = 3.84;          // epipolar distance, same as CheckFundamental
+    const float thScore = 5.99;
+    const float f2 = mfx * mfy;     // normalized plane to pixel (squared)
+
+    // Step 1: de-rotate the reference rays and compute the pure rotation errors
+    ArenaVector<cv::Point3f> vX1(N), vX2(N), vNormals(N);
+    BitMask vbRotationInliers(N);
+    int nRotationInliers = 0;
+    float scoreRotation = 0;
+    for (int i = 0; i < N; i++) {
+        const float x1 = (vPts1[i].x - mcx) * mfx_inv, y1 = (vPts1[i].y - mcy) * mfy_inv;
+        vX1[i] = cv::Point3f(mr11 * x1 + mr12 * y1 + mr13,
+                             mr21 * x1 + mr22 * y1 + mr23,
+                             mr31 * x1 + mr32 * y1 + mr33);
+        vX2[i] = cv::Point3f((vPts2[i].x - mcx) * mfx_inv, (vPts2[i].y - mcy) * mfy_inv, 1.0f);
+        vNormals[i] = vX1[i].cross(vX2[i]);
+
+        if (vX1[i].z <= 0)
+            continue;
+        const float u1in2 = mfx * vX1[i].x / vX1[i].z + mcx;
+        const float v1in2 = mfy * vX1[i].y / vX1[i].z + mcy;
+        const float chiSquare = ((vPts2[i].x - u1in2) * (vPts2[i].x - u1in2) + (vPts2[i].y - v1in2) * (vPts2[i].y - v1in2)) * invSigmaSquare;
+        if (chiSquare < thRotation) {
+            vbRotationInliers.Set(i);
+            scoreRotation += thRotation - chiSquare;
+            nRotationInliers ++;
+        }
+    }
+
+    // Step 2: 2-point RANSAC for the translation direction
+    const int maxIterations = 100;
+    const float probability = 0.99;
+    int nIterations = maxIterations;
+    int nBestInliers = 0;
+    float bestScore = 0;
+    cv::Point3f bestT(0, 0, 0);
+    BitMask vbBestInliers(N), vbCurInliers(N);
+    cv::RNG rng(0);     // fixed seed, deterministic results
+    for (int it = 0; it < nIterations; it++) {
+        const int i1 = rng.uniform(0, N);
+        int i2 = rng.uniform(0, N - 1);
+        if (i2 >= i1) i2 ++;
+
+        cv::Point3f t = vNormals[i1].cross(vNormals[i2]);
+        const float norm = std::sqrt(t.dot(t));
+        if (norm < 1e-12)
+            continue;
+        t *= 1.0f / norm;
+
+        int nInliers = 0;
+        float curScore = 0;
+        vbCurInliers.Clear();
+        for (int i = 0; i < N; i++) {
+            // l2 = t x x1', l1 = Rcl^T (x2 x t). Both have the same numerator: t^T (x1' x x2)
+            const float num = t.dot(vNormals[i]);
+            const cv::Point3f l2 = t.cross(vX1[i]);
+            const cv::Point3f m = vX2[i].cross(t);
+            const float l1x = mr11 * m.x + mr21 * m.y + mr31 * m.z;
+            const float l1y = mr12 * m.x + mr22 * m.y + mr32 * m.z;
+
+            const float chiSquare2 = f2 * num * num / (l2.x * l2.x + l2.y * l2.y + 1e-12f) * invSigmaSquare;
+            const float chiSquare1 = f2 * num * num / (l1x * l1x + l1y * l1y + 1e-12f) * invSigmaSquare;
+            if (chiSquare1 < th && chiSquare2 < th) {
+                vbCurInliers.Set(i);
+                curScore += 2 * thScore - chiSquare1 - chiSquare2;
+                nInliers ++;
+            }
+        }
+
+        if (curScore > bestScore) {
+            bestScore = curScore;
+            nBestInliers = nInliers;
+            bestT = t;
+            vbBestInliers.swap(vbCurInliers);
+
+            // Adaptive number of iterations for a 2-point minimal set
+            const float w = float(nInliers) / N;
+            const float denom = std::log(1.0f - w * w);
+            if (denom < 0)
+                nIterations = std::min(maxIterations, int(std::ceil(std::log(1.0f - probability) / denom)));
+        }
+    }
+
+    // Step 3: pure rotation test. If the rotation-only model explains almost all the tracks
+    // that the translation model explains, the translation is unobservable.
+    const float minInlierRatio = 0.5;
+    if (nRotationInliers >= 0.9 * nBestInliers) {
+        if (nRotationInliers < minInlierRatio * N)
+            return false;
+        t21 = cv::Mat::zeros(3, 1, CV_32F);
+        score = scoreRotation;
+        vbMatchesInliers.swap(vbRotationInliers);
+        return true;
     }
+
+    if (nBestInliers < minInlierRatio * N)
+        return false;
+
+    t21 = (cv::Mat_<float>(3,1) << bestT.x, bestT.y, bestT.z);
+    score = bestScore;
+    vbMatchesInliers.swap(vbBestInliers);
+    return true;
 }
 
 
 /**
  * Find the neighbors for each predicted point. The neighbors are the detected features.
- * Current implementation: Find all the neighbor feature points to the predicted point.
- *                         Using NCC score to sort the results.
+ * Current implementation: Find the neighbor feature points to the predicted point through mGridCurUn,
+ *                         and keep the best two of them, sorted by NCC score (or distance).
  * @brief GyroAidedTracker::FindAndSortNearNeighbor
- * @param mvvNearNeighbors [out]: order: if mbNCC == true, big to small; if mbNCC == false, small to big
+ * @param mvvNearNeighbors [out]: at most two neighbors. order: if mbNCC == true, big to small; if mbNCC == false, small to big
  */
 void GyroAidedTracker::FindAndSortNearNeighbor(const cv::Range& range, int level)
 {
+    std::vector<int> vIndices;
+    std::vector<float> vValuesRef;
+    vValuesRef.reserve((2 * mHalfPatchSize + 1) * (2 * mHalfPatchSize + 1));
+
+    float search_region_radiu = level * mRadiusForFindNearNeighbor;
     for (int i = range.start; i < range.end; i++) {
         if (!mvStatus[i])
             continue;
         if (!mvvNearNeighbors[i].empty())   // the neighbors have been found in lower level (i.e., small search region)
             continue;
 
-        std::vector<sMatch> vDMatchs;   // for ncc, [0]: the best correlation; for distance, [0]: the minimum distance
-        std::stack<sMatch> stDMatches_1, stDMatches_2;
+        mGridCurUn.GetFeaturesInArea(mvPtPredictUn[i], search_region_radiu, vIndices);
+        if (vIndices.empty())
+            continue;
 
         // get pixel values and mean for pt_ref
         float mean_ref = 0.0f;
-        std::vector<float> vValuesRef;
+        vValuesRef.clear();
         for (int x = -mHalfPatchSize; x <= mHalfPatchSize; x++) {
             for (int y = -mHalfPatchSize; y <= mHalfPatchSize; y++) {
                 float value_ref = GetPixelValue(mImgGrayRef, mvKeysRef[i].pt.x + x, mvKeysRef[i].pt.y + y);
@@ -808,45 +1017,36 @@ void GyroAidedTracker::FindAndSortNearNeighbor(const cv::Range& range, int level
         }
         mean_ref /= vValuesRef.size();
 
-        float search_region_radiu = level * mRadiusForFindNearNeighbor;
-        for (size_t j = 0; j < mvKeysCurUn.size(); j++) {
+        // for ncc, best: the best correlation; for distance, best: the minimum distance
+        sMatch best, second;
+        int nFound = 0;
+        for (size_t k = 0; k < vIndices.size(); k++) {
+            const int j = vIndices[k];
             cv::Point2f dpt = mvPtPredictUn[i] - mvKeysCurUn[j].pt;
-            if (abs(dpt.x) > search_region_radiu || abs(dpt.y) > search_region_radiu)
-                continue;
 
             // Euclidean distance between the predict point and detected keypoint in current frame.
             float distance = std::sqrt(dpt.x * dpt.x + dpt.y * dpt.y);
 
             // Correction between the keypoint in reference frame and the keypoint in current frame.
-            float ncc = NCC(mHalfPatchSize, vValuesRef, mean_ref, mImgGrayCur, mvKeysCur[j].pt, mvAffineDeformationMatrix[i]);
+            float ncc = NCC(mHalfPatchSize, vValuesRef, mean_ref, mImgGrayCur, mvKeysCur[j].pt, cv::Mat(mFeatures.Affine(i)));
             // float ncc = NCC(mHalfPatchSize, vValuesRef, mean_ref, mImgGrayCur, mvKeysCur[j].pt, cv::Mat()); // ncc withou warp (affine deformation matrix)
 
             sMatch match(i, j, distance, ncc, level);  // i: index of keypoint in reference frame; j: index of keypoint in current frame
-            if (mbNCC) {    // use ncc to sort the matches
-                while (!stDMatches_1.empty() && ncc < stDMatches_1.top().ncc) {
-                    stDMatches_2.push(stDMatches_1.top());
-                    stDMatches_1.pop();
-                }
+            bool bBetter = mbNCC? ncc > best.ncc: distance < best.distance;    // use ncc or distance to sort the matches
+            if (nFound == 0 || bBetter) {
+                second = best;
+                best = match;
             }
-            else {          // else, use distance to sort the matches
-                while (!stDMatches_1.empty() && distance > stDMatches_1.top().distance) {
-                    stDMatches_2.push(stDMatches_1.top());
-                    stDMatches_1.pop();
-                }
-            }
-
-            stDMatches_1.push(match);
-            while (!stDMatches_2.empty()) {
-                stDMatches_1.push(stDMatches_2.top());
-                stDMatches_2.pop();
+            else if (nFound == 1 || (mbNCC? ncc > second.ncc: distance < second.distance)) {
+                second = match;
             }
+            nFound ++;
         }
 
-        while (!stDMatches_1.empty()) {
-            vDMatchs.push_back(stDMatches_1.top());
-            stDMatches_1.pop();
-        }
-        mvvNearNeighbors[i] = std::vector<sMatch>(vDMatchs.begin(), vDMatchs.end());
+        mvvNearNeighbors[i].clear();
+        mvvNearNeighbors[i].push_back(best);
+        if (nFound > 1)
+            mvvNearNeighbors[i].push_back(second);
     }
 }
 
@@ -858,7 +1058,9 @@ void GyroAidedTracker::FindAndSortNearNeighbor(const cv::Range& range, int level
  */
 int GyroAidedTracker::SearchByGyroPredict()
 {
-    IntegrateGyroMeasurements();
+    TRACE_SCOPE("SearchByGyroPredict");
+    if(!mbHasPredictedRcl)
+        IntegrateGyroMeasurements();
 
     Timer timer, timer_begin;
 
@@ -909,6 +1111,7 @@ int GyroAidedTracker::SearchByGyroPredict()
     /// Step 2: For each predicted point in current frame, see which detected feature it belongs to.
     // Step 2.1: Find the neighbors for of predicted point. The neighbors are the detected features.
     //           radius: mRadiusForFindNearNeighbor (default: 4.0f)
+    mGridCurUn.Build(mvKeysCurUn, mWidth, mHeight, mRadiusForFindNearNeighbor);
     cv::parallel_for_(cv::Range(0, mN), std::bind(&GyroAidedTracker::FindAndSortNearNeighbor, this, placeholders::_1, 1));
     mTimeFindNearest = timer.runTime_s();   timer.freshTimer();
 
@@ -943,14 +1146,19 @@ int GyroAidedTracker::SearchByGyroPredict()
  * See which detected features the predicted point belongs to.
  * @brief GyroAidedTracker::MatchFeatures
  * @param vMatches
- * @param sFoundInCurPts
  * @param vvNearNeighbors
+ * Note: a keypoint in current frame that is chosen by more than one reference keypoint is ambiguous,
+ *       all of its matches are rejected. The owner array records, for each current keypoint,
+ *       the index of its match in vMatches (-1: not matched yet; -2: conflicted).
  */
 void GyroAidedTracker::MatchFeatures(
         std::vector<sMatch> &vMatches,
         const vector<vector<sMatch>> &vvNearNeighbors)
 {
-    std::set<int> sFoundInCurPts;
+    const int UNMATCHED = -1, CONFLICTED = -2;
+    std::vector<int> vOwner(mvKeysCur.size(), UNMATCHED);
+    for (size_t k = 0; k < vMatches.size(); k++)
+        vOwner[vMatches[k].trainIdx] = k;
     for (int i = 0; i < mN; i++) {
         if (vvNearNeighbors[i].empty()) // no neighbors
             continue;
@@ -990,22 +1198,29 @@ void GyroAidedTracker::MatchFeatures(
         }
 
         ///////////////////////
-        if (sFoundInCurPts.find(_m.trainIdx) == sFoundInCurPts.end()){ // not matched yet
+        int &owner = vOwner[_m.trainIdx];
+        if (owner == UNMATCHED){ // not matched yet
+            owner = vMatches.size();
             vMatches.push_back(_m);
-            sFoundInCurPts.insert(_m.trainIdx);
         }
-        else {
+        else if (owner >= 0) {
             // Wrong match: This keypoint in the current frame has been matched.
-            // We delete the previous matches and prohibit the matches to this keypoint
-            std::vector<sMatch>::iterator it = vMatches.begin();
-            while (it != vMatches.end()) {
-                if (it->trainIdx == _m.trainIdx)
-                    it = vMatches.erase(it);
-                else
-                    it ++;
-            }
+            // We invalidate the previous match and prohibit the matches to this keypoint
+            vMatches[owner].trainIdx = -1;
+            owner = CONFLICTED;
         }
     }
+
+    // Compact: remove the invalidated matches and keep the order
+    size_t n = 0;
+    for (size_t k = 0; k < vMatches.size(); k++) {
+        if (vMatches[k].trainIdx < 0)
+            continue;
+        if (n != k)
+            vMatches[n] = vMatches[k];
+        n ++;
+    }
+    vMatches.resize(n);
 }
 
 
@@ -1016,6 +1231,7 @@ void GyroAidedTracker::MatchFeatures(
  */
 int GyroAidedTracker::SearchByOpencvKLT()
 {
+    TRACE_SCOPE("SearchByOpencvKLT");
     std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
     if (mImgGrayRef.empty() || mImgGrayCur.empty()){
@@ -1057,18 +1273,41 @@ int GyroAidedTracker::SearchByOpencvKLT()
     }
 
     // Step 2: for each optical flow point in current frame, see which detected feature it belongs to
-    cv::Mat pt_cur_klt_find_flat = cv::Mat(pt_cur_klt_find).reshape(1, pt_cur_klt_find.size()); // flatten array
-    cv::Mat pt_cur_detected_flat = cv::Mat(pt_cur_detected).reshape(1, pt_cur_detected.size());
-
-    // find the neraest ORB feature points to the optical flow point
-    vector< vector<cv::DMatch> > nearest_neighbors;
-    cv::BFMatcher matcher(cv::NORM_L2);
+    // find the neraest ORB feature points to the optical flow point (at most two, sorted by distance)
     float maxDistance = 4.0f;
-    matcher.radiusMatch(pt_cur_klt_find_flat, pt_cur_detected_flat, nearest_neighbors, maxDistance); //2.0f
+    KeyPointGrid gridCur;
+    gridCur.Build(pt_cur_detected, mWidth, mHeight, maxDistance);
+
+    vector< vector<cv::DMatch> > nearest_neighbors(pt_cur_klt_find.size());
+    std::vector<int> vIndices;
+    for (size_t i = 0; i < pt_cur_klt_find.size(); i++) {
+        gridCur.GetFeaturesInArea(pt_cur_klt_find[i], maxDistance, vIndices);
+
+        cv::DMatch best(i, -1, maxDistance + 1), second(i, -1, maxDistance + 1);
+        for (size_t k = 0; k < vIndices.size(); k++) {
+            cv::Point2f dpt = pt_cur_klt_find[i] - pt_cur_detected[vIndices[k]];
+            float distance = std::sqrt(dpt.x * dpt.x + dpt.y * dpt.y);
+            if (distance > maxDistance)
+                continue;
+
+            if (distance < best.distance) {
+                second = best;
+                best = cv::DMatch(i, vIndices[k], distance);
+            }
+            else if (distance < second.distance) {
+                second = cv::DMatch(i, vIndices[k], distance);
+            }
+        }
+
+        if (best.trainIdx >= 0)
+            nearest_neighbors[i].push_back(best);
+        if (second.trainIdx >= 0)
+            nearest_neighbors[i].push_back(second);
+    }
 
     // Step 3: Check that the found neighbors are unique
     //         (throw away neighbors that are too close to each other, as they may be confusing)
-    std::set<int> found_in_cur_pts;
+    std::vector<bool> vbFoundInCurPts(pt_cur_detected.size(), false);   // owner array, the first match wins
     double maxDisparity_1 = 0, sumDisparity_1 = 0;
     vector<cv::DMatch> vMatches_nearest_negihbor; // used for display
     for(size_t i = 0; i < nearest_neighbors.size(); i++){
@@ -1086,7 +1325,7 @@ int GyroAidedTracker::SearchByOpencvKLT()
         else    // no neighbors
             continue;
 
-        if(found_in_cur_pts.find(_m.trainIdx) == found_in_cur_pts.end()){
+        if(!vbFoundInCurPts[_m.trainIdx]){
             // We should match it with the original indexing of the left point
             _m.queryIdx = pt_cur_klt_find_index[_m.queryIdx];
             mvMatches.push_back(sMatch(_m.queryIdx, _m.trainIdx, _m.distance));
@@ -1101,32 +1340,33 @@ int GyroAidedTracker::SearchByOpencvKLT()
             sumDisparity_1 += disp;
             maxDisparity_1 = disp > maxDisparity_1? disp : maxDisparity_1;
 
-            found_in_cur_pts.insert(_m.trainIdx);
+            vbFoundInCurPts[_m.trainIdx] = true;
         }
     }
 
     // average disparity. used to filter out large disparity matching
     double avgDisparity_1 = sumDisparity_1/mvDisparities.size();
 
-    // Step 4: filter large disparity
-    std::vector<double>::iterator itDisp = mvDisparities.begin();
-    std::vector<sMatch>::iterator itMatch = mvMatches.begin();
+    // Step 4: filter large disparity. Compact mvDisparities and mvMatches in one pass.
     double maxDisparity_2 = 0; double sumDisparity_2 = 0;
     double filterOutFactor = 1.5;
     double th = avgDisparity_1 * filterOutFactor;
-    while (itDisp != mvDisparities.end()) {
+    size_t n = 0;
+    for (size_t k = 0, kend = mvDisparities.size(); k < kend; k++) {
         // filter out the matches whose disparity is larger than thDisparity*avgDisparity
-        if(*itDisp > th){
-            itDisp = mvDisparities.erase(itDisp);
-            itMatch = mvMatches.erase(itMatch);
-        }
-        else {
-            sumDisparity_2 += *itDisp;
-            maxDisparity_2 = *itDisp > maxDisparity_2? *itDisp : maxDisparity_2;
-            itDisp ++;
-            itMatch ++;
+        if(mvDisparities[k] > th)
+            continue;
+
+        sumDisparity_2 += mvDisparities[k];
+        maxDisparity_2 = mvDisparities[k] > maxDisparity_2? mvDisparities[k] : maxDisparity_2;
+        if (n != k) {
+            mvDisparities[n] = mvDisparities[k];
+            mvMatches[n] = mvMatches[k];
         }
+        n ++;
     }
+    mvDisparities.resize(n);
+    mvMatches.resize(n);
     double avgDisparity_2 = sumDisparity_2/mvMatches.size();
 
     std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
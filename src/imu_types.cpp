@@ -21,7 +21,48 @@
 */
 
 #include "imu_types.h"
+#include "table_cache.h"
 #include<iostream>
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+void CameraParams::InitRectifyMaps(const std::string &mapCachePath)
+{
+    // undistort and keep the size. has black region
+    cv::Size imageSize = cv::Size(width, height);
+    double alpha = 0;   // Free scaling parameter between 0 (when all the pixels in the undistorted image are
+                        // valid) and 1 (when all the source image pixels are retained in the undistorted image).
+    const int mapType = CV_16SC2;   // fixed-point maps, see GrayRectifier
+
+    // key of the cache: everything the maps are computed from
+    uint64_t hash = 0;
+    if(!mapCachePath.empty()){
+        const int vSize[3] = {width, height, mapType};
+        hash = TableCache::Hash(vSize, sizeof(vSize));
+        hash = TableCache::Hash(&alpha, sizeof(alpha), hash);
+        hash = TableCache::Hash(mK.data, mK.total() * mK.elemSize(), hash);
+        hash = TableCache::Hash(mDistCoef.data, mDistCoef.total() * mDistCoef.elemSize(), hash);
+
+        mpMapCache.reset(new TableCache());
+        if(mpMapCache->Open(mapCachePath, hash) && mpMapCache->GetTableNumber() == 2){
+            M1 = mpMapCache->GetTable(0);
+            M2 = mpMapCache->GetTable(1);
+            return;
+        }
+        mpMapCache.reset();
+    }
+
+    cv::initUndistortRectifyMap(mK, mDistCoef, cv::Mat(),
+                                cv::getOptimalNewCameraMatrix(mK, mDistCoef, imageSize, alpha, imageSize, 0),
+                                imageSize, mapType, M1, M2);
+
+    if(!mapCachePath.empty()){
+        std::vector<cv::Mat> vTables;
+        vTables.push_back(M1);
+        vTables.push_back(M2);
+        if(TableCache::Save(mapCachePath, hash, vTables))
+            LOG(INFO) << "Rectification maps cached in " << mapCachePath;
+    }
+}
 
 
 namespace IMU
@@ -515,4 +556,138 @@ Calib::Calib(const Calib &calib)
     dt = calib.dt;
 }
 
+GyroIntegrator::GyroIntegrator(const Calib &calib, const cv::Point3f &biasg_, const int &maxStates):
+    mBiasg(biasg_), mnMaxStates(maxStates)
+{
+    mRbc = calib.Tbc.rowRange(0,3).colRange(0,3).clone();
+    mvStates.reserve(mnMaxStates);
+}
+
+void GyroIntegrator::SetBias(const cv::Point3f &biasg_)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mBiasg = biasg_;
+}
+
+cv::Mat GyroIntegrator::IntegrateOneStep(const cv::Mat &R, const cv::Point3f &angVel, const double &dt) const
+{
+    return R * ExpSO3((angVel.x - mBiasg.x) * dt, (angVel.y - mBiasg.y) * dt, (angVel.z - mBiasg.z) * dt);
+}
+
+// Rotation from tRef to t and the angular velocity at t. Note: the mutex should be locked by the caller.
+cv::Mat GyroIntegrator::DeltaRotation(const double &t, cv::Point3f &w) const
+{
+    // Find the last state before t. Usually it is the newest one.
+    int i = mvStates.size() - 1;
+    while(i > 0 && mvStates[i].t > t)
+        i--;
+
+    const state &s = mvStates[i];
+    if(i + 1 < (int)mvStates.size()){
+        // t lies between two measurements: interpolate the angular velocity at t
+        const state &s1 = mvStates[i+1];
+        const double tab = s1.t - s.t;
+        w = s.w + (s1.w - s.w) * float((t - s.t) / tab);
+    }else {
+        w = s.w;    // no measurement after t yet: hold the newest one
+    }
+
+    const double dt = t - s.t;
+    if(dt <= 0)
+        return s.R.clone();
+
+    return IntegrateOneStep(s.R, (s.w + w) * 0.5f, dt);
+}
+
+void GyroIntegrator::Reset(const double &tRef)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if(!mbInitialized || mvStates.empty()){
+        mvStates.clear();
+        mvStates.push_back(state(tRef, mbHasLast? mwLast: cv::Point3f(0,0,0), cv::Mat::eye(3,3,CV_32F)));
+        mtRef = tRef;
+        mbInitialized = true;
+        return;
+    }
+
+    cv::Point3f wRef;
+    cv::Mat RrefInv = DeltaRotation(tRef, wRef).t();
+
+    std::vector<state> vStates;
+    vStates.reserve(mnMaxStates);
+    vStates.push_back(state(tRef, wRef, cv::Mat::eye(3,3,CV_32F)));
+    for(size_t i = 0; i < mvStates.size(); i++){
+        const state &s = mvStates[i];
+        if(s.t <= tRef){
+            mbHasLast = true;
+            mtLast = s.t;
+            mwLast = s.w;
+        }else {
+            vStates.push_back(state(s.t, s.w, RrefInv * s.R));
+        }
+    }
+
+    mvStates.swap(vStates);
+    mtRef = tRef;
+}
+
+void GyroIntegrator::IntegrateNewMeasurement(const Point &imu)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if(!mbInitialized || imu.t <= mtRef){
+        // Before the first image or before the reference timestamp: remember it for the boundary interpolation.
+        mbHasLast = true;
+        mtLast = imu.t;
+        mwLast = imu.w;
+        if(mbInitialized && mvStates.size() == 1)
+            mvStates[0].w = imu.w;
+        return;
+    }
+
+    const state &back = mvStates.back();
+    if(imu.t <= back.t)  // out of order
+        return;
+
+    if(mvStates.size() == 1 && mbHasLast && mtLast < mtRef){
+        // Interpolate the angular velocity at tRef
+        const double tab = imu.t - mtLast;
+        mvStates[0].w = mwLast + (imu.w - mwLast) * float((mtRef - mtLast) / tab);
+    }
+
+    cv::Mat R = IntegrateOneStep(back.R, (back.w + imu.w) * 0.5f, imu.t - back.t);
+    mvStates.push_back(state(imu.t, imu.w, R));
+
+    // No image for a long time: drop the intermediate measurements to bound the memory. The anchor at tRef and
+    // the newest state are kept, so R still integrates from tRef; only the interpolation inside the gap is lost.
+    if((int)mvStates.size() > mnMaxStates){
+        LOG(WARNING) << "GyroIntegrator: more than " << mnMaxStates << " measurements since the image at " << std::fixed
+                     << mtRef << ", the intermediate ones are dropped";
+        mvStates.erase(mvStates.begin() + 1, mvStates.end() - 1);
+    }
+}
+
+cv::Mat GyroIntegrator::GetDeltaRotation(const double &t)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if(mvStates.empty())
+        return cv::Mat::eye(3,3,CV_32F);
+
+    cv::Point3f w;
+    return DeltaRotation(t, w);
+}
+
+cv::Mat GyroIntegrator::GetRcl(const double &t)
+{
+    cv::Mat dR_ref_cur = GetDeltaRotation(t);
+    return mRbc.t() * dR_ref_cur.t() * mRbc;
+}
+
+int GyroIntegrator::GetMeasurementNumber()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mvStates.empty()? 0: mvStates.size() - 1;
+}
+
 } //namespace IMU
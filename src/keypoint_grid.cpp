@@ -0,0 +1,101 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "keypoint_grid.h"
+#include <algorithm>
+#include <cmath>
+
+void KeyPointGrid::Build(const std::vector<cv::KeyPoint> &vKeys, int width, int height, float cellSize)
+{
+    mvPts.resize(vKeys.size());
+    for(size_t i = 0, iend = vKeys.size(); i < iend; i++)
+        mvPts[i] = vKeys[i].pt;
+
+    Build(width, height, cellSize);
+}
+
+void KeyPointGrid::Build(const std::vector<cv::Point2f> &vPts, int width, int height, float cellSize)
+{
+    mvPts.assign(vPts.begin(), vPts.end());
+    Build(width, height, cellSize);
+}
+
+inline int KeyPointGrid::CellCol(float x) const
+{
+    int c = int(std::floor(x * mfCellSizeInv));
+    return std::min(std::max(c, 0), mnCols - 1);
+}
+
+inline int KeyPointGrid::CellRow(float y) const
+{
+    int r = int(std::floor(y * mfCellSizeInv));
+    return std::min(std::max(r, 0), mnRows - 1);
+}
+
+void KeyPointGrid::Build(int width, int height, float cellSize)
+{
+    cellSize = cellSize > 1.0f? cellSize: 1.0f;
+    mfCellSizeInv = 1.0f / cellSize;
+    mnCols = std::max(1, int(std::ceil(width * mfCellSizeInv)));
+    mnRows = std::max(1, int(std::ceil(height * mfCellSizeInv)));
+
+    const int nCells = mnCols * mnRows;
+    const int N = mvPts.size();
+
+    // Count the points of each cell, then compute the start offset of each cell
+    std::vector<int> vCell(N);
+    mvCellStart.assign(nCells + 1, 0);
+    for(int i = 0; i < N; i++){
+        vCell[i] = CellRow(mvPts[i].y) * mnCols + CellCol(mvPts[i].x);
+        mvCellStart[vCell[i] + 1] ++;
+    }
+    for(int c = 0; c < nCells; c++)
+        mvCellStart[c + 1] += mvCellStart[c];
+
+    std::vector<int> vFill(mvCellStart.begin(), mvCellStart.end() - 1);
+    mvIndices.resize(N);
+    for(int i = 0; i < N; i++)
+        mvIndices[vFill[vCell[i]] ++] = i;
+}
+
+void KeyPointGrid::GetFeaturesInArea(const cv::Point2f &pt, float r, std::vector<int> &vIndices) const
+{
+    vIndices.clear();
+    if(mvPts.empty())
+        return;
+
+    const int minCol = CellCol(pt.x - r), maxCol = CellCol(pt.x + r);
+    const int minRow = CellRow(pt.y - r), maxRow = CellRow(pt.y + r);
+    for(int row = minRow; row <= maxRow; row++){
+        for(int col = minCol; col <= maxCol; col++){
+            const int c = row * mnCols + col;
+            for(int k = mvCellStart[c]; k < mvCellStart[c + 1]; k++){
+                const int idx = mvIndices[k];
+                const cv::Point2f &p = mvPts[idx];
+                if(std::abs(p.x - pt.x) > r || std::abs(p.y - pt.y) > r)
+                    continue;
+                vIndices.push_back(idx);
+            }
+        }
+    }
+}
@@ -0,0 +1,246 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "keypoint_store.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+namespace {
+
+const char MAGIC[8] = "KPSTORE";
+const uint32_t VERSION = 2;
+
+struct sFrameText{
+    double t;
+    std::string name;
+    bool operator<(const sFrameText &f) const {return t < f.t;}
+};
+
+bool CompareEntryTime(const KeypointStore::sFrameEntry &e, double t)
+{
+    return e.t < t;
+}
+
+// Read the time correspondences of <folder>/corresponds.txt, in the order of the file
+bool ReadCorrespondences(const std::string &folder, std::vector<sFrameText> &vFrames)
+{
+    std::ifstream fin((folder + "/corresponds.txt").c_str());
+    if(!fin.is_open()){
+        LOG(ERROR) << "open file failed. file: " << folder + "/corresponds.txt";
+        return false;
+    }
+    std::string line;
+    while(getline(fin, line)){
+        std::string::size_type p_dot = line.find(",");
+        if(p_dot == std::string::npos)
+            continue;
+        sFrameText f;
+        f.t = std::atof(line.substr(0, p_dot).c_str());
+        f.name = line.substr(std::min(p_dot + 2, line.size()));
+        vFrames.push_back(f);
+    }
+    return true;
+}
+
+// FNV-1a
+void HashBytes(uint64_t &h, const void* pData, size_t n)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(pData);
+    for(size_t i = 0; i < n; i++){
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+void HashFile(uint64_t &h, const std::string &file)
+{
+    struct stat st;
+    int64_t size = -1, mtime = 0;
+    if(stat(file.c_str(), &st) == 0){
+        size = st.st_size;
+        mtime = st.st_mtime;
+    }
+    HashBytes(h, file.data(), file.size());
+    HashBytes(h, &size, sizeof(size));
+    HashBytes(h, &mtime, sizeof(mtime));
+}
+
+} // namespace
+
+KeypointStore::KeypointStore():
+    mpData(NULL), mnSize(0), mpHeader(NULL), mpFrames(NULL), mpPoints(NULL)
+{
+}
+
+KeypointStore::~KeypointStore()
+{
+    Close();
+}
+
+void KeypointStore::Close()
+{
+    if(mpData)
+        munmap(mpData, mnSize);
+    mpData = NULL;
+    mnSize = 0;
+    mpHeader = NULL;
+    mpFrames = NULL;
+    mpPoints = NULL;
+}
+
+bool KeypointStore::Open(const std::string &path, const std::string &folder)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(sHeader)){
+        close(fd);
+        return false;
+    }
+
+    void* pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping stays valid
+    if(pData == MAP_FAILED)
+        return false;
+
+    const sHeader* pHeader = static_cast<const sHeader*>(pData);
+    const size_t nExpected = sizeof(sHeader) + size_t(pHeader->nFrames) * sizeof(sFrameEntry)
+            + size_t(pHeader->nPoints) * sizeof(cv::Point2f);
+    if(memcmp(pHeader->magic, MAGIC, sizeof(MAGIC)) != 0 || pHeader->version != VERSION
+            || size_t(st.st_size) != nExpected){
+        LOG(ERROR) << "Invalid keypoint store: " << path;
+        munmap(pData, st.st_size);
+        return false;
+    }
+    if(!folder.empty() && pHeader->nSource != Fingerprint(folder)){
+        LOG(INFO) << "The keypoint store is older than the files in " << folder << ": " << path;
+        munmap(pData, st.st_size);
+        return false;
+    }
+
+    mpData = pData;
+    mnSize = st.st_size;
+    mpHeader = pHeader;
+    mpFrames = reinterpret_cast<const sFrameEntry*>(pHeader + 1);
+    mpPoints = reinterpret_cast<const cv::Point2f*>(mpFrames + pHeader->nFrames);
+    madvise(mpData, mnSize, MADV_SEQUENTIAL);
+    return true;
+}
+
+int KeypointStore::Find(double t, double eps) const
+{
+    if(!mpHeader)
+        return -1;
+
+    const sFrameEntry* pEnd = mpFrames + mpHeader->nFrames;
+    const sFrameEntry* it = std::lower_bound(mpFrames, pEnd, t - eps, CompareEntryTime);
+    if(it == pEnd || std::abs(it->t - t) >= eps)
+        return -1;
+    return int(it - mpFrames);
+}
+
+bool KeypointStore::Convert(const std::string &folder, const std::string &path)
+{
+    // fingerprint the sources before reading them, a file changed meanwhile makes the store stale
+    const uint64_t nSource = Fingerprint(folder);
+
+    // read the time correspondences
+    std::vector<sFrameText> vFrames;
+    if(!ReadCorrespondences(folder, vFrames))
+        return false;
+    std::stable_sort(vFrames.begin(), vFrames.end());
+
+    // read the keypoints of each frame
+    std::vector<sFrameEntry> vEntries(vFrames.size());
+    std::vector<cv::Point2f> vPoints;
+    std::string line;
+    for(size_t i = 0; i < vFrames.size(); i++){
+        sFrameEntry &e = vEntries[i];
+        e.t = vFrames[i].t;
+        e.nFirst = vPoints.size();
+        e.reserved = 0;
+
+        std::ifstream fpts((folder + "/" + vFrames[i].name + ".txt").c_str());
+        if(!fpts.is_open())
+            LOG(ERROR) << "open file failed. file: " << folder + "/" + vFrames[i].name + ".txt";
+        while(getline(fpts, line)){
+            std::istringstream sin(line);
+            std::vector<double> data;
+            std::string field;
+            while (getline(sin, field, ','))
+                data.push_back(std::atof(field.c_str()));
+            if(data.size() >= 3)
+                vPoints.push_back(cv::Point2f(data[1], data[2]));
+        }
+        e.n = vPoints.size() - e.nFirst;
+    }
+
+    // write to a temporary file, then rename, so that a partial file is never opened
+    sHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.nFrames = vEntries.size();
+    header.nPoints = vPoints.size();
+    header.nSource = nSource;
+
+    const std::string tmp = path + ".tmp";
+    std::ofstream fout(tmp.c_str(), std::ios::binary);
+    if(!fout.is_open()){
+        LOG(ERROR) << "open file failed. file: " << tmp;
+        return false;
+    }
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if(!vEntries.empty())
+        fout.write(reinterpret_cast<const char*>(vEntries.data()), vEntries.size() * sizeof(sFrameEntry));
+    if(!vPoints.empty())
+        fout.write(reinterpret_cast<const char*>(vPoints.data()), vPoints.size() * sizeof(cv::Point2f));
+    fout.close();
+    if(!fout || rename(tmp.c_str(), path.c_str()) != 0){
+        LOG(ERROR) << "write file failed. file: " << path;
+        return false;
+    }
+
+    LOG(INFO) << "Converted " << vEntries.size() << " frames, " << vPoints.size() << " keypoints to " << path;
+    return true;
+}
+
+uint64_t KeypointStore::Fingerprint(const std::string &folder)
+{
+    // one stat(), the store is checked at every startup and must not parse the text files
+    uint64_t h = 14695981039346656037ULL;
+    HashFile(h, folder + "/corresponds.txt");
+    return h;
+}
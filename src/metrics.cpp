@@ -0,0 +1,216 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "metrics.h"
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+Histogram::Histogram(const std::string &name, const std::string &help, double scale):
+    mName(name), mHelp(help), mScale(scale), mnCount(0), mnSum(0), mnMax(0)
+{
+    for(int i = 0; i < BUCKETS; i++)
+        mvBuckets[i].store(0, std::memory_order_relaxed);
+}
+
+int Histogram::BucketIndex(uint64_t v)
+{
+    if(v < uint64_t(SUB_BUCKETS))
+        return v;
+    const int e = 63 - __builtin_clzll(v);    // floor(log2(v)) >= SUB_BUCKET_BITS
+    const int sub = (v >> (e - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return SUB_BUCKETS + (e - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::BucketLowerBound(int idx)
+{
+    if(idx < SUB_BUCKETS)
+        return idx;
+    const int e = (idx - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+    const int sub = (idx - SUB_BUCKETS) % SUB_BUCKETS;
+    return uint64_t(SUB_BUCKETS + sub) << (e - SUB_BUCKET_BITS);
+}
+
+void Histogram::Record(double value)
+{
+    // negative and NaN values are clamped to zero
+    const uint64_t v = value * mScale > 0? uint64_t(value * mScale + 0.5): 0;
+    mvBuckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+    mnCount.fetch_add(1, std::memory_order_relaxed);
+    mnSum.fetch_add(v, std::memory_order_relaxed);
+
+    uint64_t vMax = mnMax.load(std::memory_order_relaxed);
+    while(v > vMax && !mnMax.compare_exchange_weak(vMax, v, std::memory_order_relaxed))
+        ;
+}
+
+double Histogram::Quantile(double q) const
+{
+    // The buckets are read one by one, the result is approximate while other threads are recording
+    uint64_t total = 0;
+    for(int i = 0; i < BUCKETS; i++)
+        total += mvBuckets[i].load(std::memory_order_relaxed);
+    if(total == 0)
+        return 0;
+
+    const uint64_t rank = std::max<uint64_t>(1, uint64_t(q * total + 0.5));
+    uint64_t cnt = 0;
+    for(int i = 0; i < BUCKETS; i++){
+        cnt += mvBuckets[i].load(std::memory_order_relaxed);
+        if(cnt >= rank){
+            // middle of the bucket, not larger than the maximum
+            const uint64_t lower = BucketLowerBound(i);
+            const uint64_t upper = i + 1 < BUCKETS? BucketLowerBound(i + 1): lower;
+            const double v = 0.5 * (lower + upper - (upper > lower? 1: 0));
+            return std::min(v, double(mnMax.load(std::memory_order_relaxed))) / mScale;
+        }
+    }
+    return Max();
+}
+
+std::string sMetricsSnapshot::ToPrometheusText() const
+{
+    std::stringstream s;
+    s << std::setprecision(9);
+    for(size_t i = 0; i < vCounters.size(); i++){
+        const sCounter &c = vCounters[i];
+        s << "# HELP " << c.name << " " << c.help << "\n"
+          << "# TYPE " << c.name << " counter\n"
+          << c.name << " " << c.value << "\n";
+    }
+    for(size_t i = 0; i < vHistograms.size(); i++){
+        const sHistogram &h = vHistograms[i];
+        s << "# HELP " << h.name << " " << h.help << "\n"
+          << "# TYPE " << h.name << " summary\n"
+          << h.name << "{quantile=\"0.5\"} " << h.p50 << "\n"
+          << h.name << "{quantile=\"0.9\"} " << h.p90 << "\n"
+          << h.name << "{quantile=\"0.99\"} " << h.p99 << "\n"
+          << h.name << "{quantile=\"0.999\"} " << h.p999 << "\n"
+          << h.name << "{quantile=\"1\"} " << h.max << "\n"
+          << h.name << "_sum " << h.sum << "\n"
+          << h.name << "_count " << h.count << "\n";
+    }
+    return s.str();
+}
+
+MetricsRegistry* MetricsRegistry::GetInstance()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+    StopPeriodicDump();
+}
+
+Counter* MetricsRegistry::GetCounter(const std::string &name, const std::string &help)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    std::unique_ptr<Counter> &pCounter = mmCounters[name];
+    if(!pCounter)
+        pCounter.reset(new Counter(name, help));
+    return pCounter.get();
+}
+
+Histogram* MetricsRegistry::GetHistogram(const std::string &name, const std::string &help, double scale)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    std::unique_ptr<Histogram> &pHistogram = mmHistograms[name];
+    if(!pHistogram)
+        pHistogram.reset(new Histogram(name, help, scale));
+    return pHistogram.get();
+}
+
+sMetricsSnapshot MetricsRegistry::Snapshot()
+{
+    sMetricsSnapshot snapshot;
+    snapshot.t = std::chrono::duration_cast<std::chrono::duration<double> >(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    for(std::map<std::string, std::unique_ptr<Counter> >::const_iterator it = mmCounters.begin(); it != mmCounters.end(); it++){
+        sMetricsSnapshot::sCounter c;
+        c.name = it->second->mName;
+        c.help = it->second->mHelp;
+        c.value = it->second->Value();
+        snapshot.vCounters.push_back(c);
+    }
+    for(std::map<std::string, std::unique_ptr<Histogram> >::const_iterator it = mmHistograms.begin(); it != mmHistograms.end(); it++){
+        const Histogram* pHistogram = it->second.get();
+        sMetricsSnapshot::sHistogram h;
+        h.name = pHistogram->mName;
+        h.help = pHistogram->mHelp;
+        h.count = pHistogram->Count();
+        h.sum = pHistogram->Sum();
+        h.max = pHistogram->Max();
+        h.p50 = pHistogram->Quantile(0.5);
+        h.p90 = pHistogram->Quantile(0.9);
+        h.p99 = pHistogram->Quantile(0.99);
+        h.p999 = pHistogram->Quantile(0.999);
+        snapshot.vHistograms.push_back(h);
+    }
+    return snapshot;
+}
+
+bool MetricsRegistry::Dump(const std::string &filename)
+{
+    const std::string tmp = filename + ".tmp";
+    {
+        std::ofstream fp(tmp.c_str());
+        if(!fp.is_open())
+            return false;
+        fp << Snapshot().ToPrometheusText();
+    }
+    return std::rename(tmp.c_str(), filename.c_str()) == 0;
+}
+
+void MetricsRegistry::StartPeriodicDump(const std::string &filename, double period)
+{
+    StopPeriodicDump();
+    mbStop = false;
+    mThreadDump = std::thread(&MetricsRegistry::RunDump, this, filename, period);
+}
+
+void MetricsRegistry::StopPeriodicDump()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexDump);
+        mbStop = true;
+    }
+    mConditionDump.notify_all();
+    if(mThreadDump.joinable())
+        mThreadDump.join();
+}
+
+void MetricsRegistry::RunDump(std::string filename, double period)
+{
+    std::unique_lock<std::mutex> lock(mMutexDump);
+    while(!mbStop){
+        mConditionDump.wait_for(lock, std::chrono::milliseconds(int(period * 1000)));
+        Dump(filename);
+    }
+}
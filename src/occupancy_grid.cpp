@@ -0,0 +1,91 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "occupancy_grid.h"
+#include <algorithm>
+#include <cmath>
+
+void OccupancyGrid::Reset(int width, int height, int cellSize)
+{
+    mnCellSize = std::max(cellSize, 1);
+    mfCellSizeInv = 1.0f / mnCellSize;
+    mnWidth = std::max(width, 1);
+    mnHeight = std::max(height, 1);
+    mnCols = (mnWidth + mnCellSize - 1) / mnCellSize;
+    mnRows = (mnHeight + mnCellSize - 1) / mnCellSize;
+    mvCells.assign(mnCols * mnRows, 0);
+}
+
+void OccupancyGrid::Mark(const cv::Point2f &pt, float r)
+{
+    // cells c with center (c + 0.5) * cellSize in [x - r, x + r)
+    int c0 = int(std::ceil((pt.x - r) * mfCellSizeInv - 0.5f));
+    int c1 = int(std::ceil((pt.x + r) * mfCellSizeInv - 0.5f)) - 1;
+    int r0 = int(std::ceil((pt.y - r) * mfCellSizeInv - 0.5f));
+    int r1 = int(std::ceil((pt.y + r) * mfCellSizeInv - 0.5f)) - 1;
+    if(c1 < c0)
+        c0 = c1 = CellCol(pt.x);
+    if(r1 < r0)
+        r0 = r1 = CellRow(pt.y);
+
+    c0 = std::max(c0, 0); c1 = std::min(c1, mnCols - 1);
+    r0 = std::max(r0, 0); r1 = std::min(r1, mnRows - 1);
+    for(int r = r0; r <= r1; r++){
+        uchar* pRow = &mvCells[r * mnCols];
+        for(int c = c0; c <= c1; c++)
+            pRow[c] = 1;
+    }
+}
+
+bool OccupancyGrid::IsRegionOccupied(float x0, float y0, float x1, float y1) const
+{
+    if(mvCells.empty())
+        return false;
+
+    // the pixels are in [x0, x1 - 1]
+    const int c0 = CellCol(x0), c1 = CellCol(std::max(x0, x1 - 1));
+    const int r0 = CellRow(y0), r1 = CellRow(std::max(y0, y1 - 1));
+    for(int r = r0; r <= r1; r++){
+        const uchar* pRow = &mvCells[r * mnCols];
+        for(int c = c0; c <= c1; c++){
+            if(!pRow[c])
+                return false;
+        }
+    }
+    return true;
+}
+
+cv::Mat OccupancyGrid::GetMask() const
+{
+    cv::Mat mask(mnHeight, mnWidth, CV_8UC1, cv::Scalar(1));
+    for(int r = 0; r < mnRows; r++){
+        for(int c = 0; c < mnCols; c++){
+            if(!mvCells[r * mnCols + c])
+                continue;
+            const cv::Rect cell(c * mnCellSize, r * mnCellSize,
+                                std::min(mnCellSize, mnWidth - c * mnCellSize),
+                                std::min(mnCellSize, mnHeight - r * mnCellSize));
+            mask(cell).setTo(0);
+        }
+    }
+    return mask;
+}
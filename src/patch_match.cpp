@@ -26,6 +26,9 @@
 #include <pthread.h>
 #include <omp.h>
 #include "utils.h"
+#include "trace.h"
+#include "stage_scope.h"
+#include "frame_arena.h"
 
 typedef Eigen::Matrix<double, 5, 1> Vector5d;
 typedef Eigen::Matrix<double, 5, 5> Matrix5d;
@@ -37,7 +40,8 @@ PatchMatch::PatchMatch(GyroAidedTracker* pMatcher_,
                        bool bRegularizationPenalty_,
                        bool bCalculateNCC_):
     mpMatcher(pMatcher_),
-    mN(pMatcher_->mvKeysRef.size()),
+    mFeatures(pMatcher_->mFeatures),
+    mN(pMatcher_->mFeatures.size()),
     mHalfPatchSize(halfPatchSize_), mIterations(iterations_), mPyramids(pyramids_),
     mbHasGyroPredictInitial(bHasGyroPredictInitial_), mbInverse(bInverse_),
     mbConsiderIllumination(bConsiderIllumination_), mbConsiderAffineDeformation(bConsiderAffineDeformation_),
@@ -55,7 +59,6 @@ PatchMatch::PatchMatch(GyroAidedTracker* pMatcher_,
     mLevel = 0;
 
     mWinSizeInv = 1.0f / (2.0f * mHalfPatchSize + 1.0f) / (2.0f * mHalfPatchSize + 1.0f);
-    mvGyroPredictStatus = std::vector<uchar>(pMatcher_->mvStatus.begin(), pMatcher_->mvStatus.end());
 }
 
 void PatchMatch::CreatePyramids(){
@@ -65,9 +68,14 @@ void PatchMatch::CreatePyramids(){
             mvImgPyr2.push_back(mpMatcher->mImgGrayCur);
             mvScales.push_back(1.0f);
         } else {
-            cv::Mat img1_pyr, img2_pyr;
-            cv::resize(mvImgPyr1[i-1], img1_pyr, cv::Size(mvImgPyr1[i-1].cols * mPyramidScale, mvImgPyr1[i-1].rows * mPyramidScale));
-            cv::resize(mvImgPyr2[i-1], img2_pyr, cv::Size(mvImgPyr2[i-1].cols * mPyramidScale, mvImgPyr2[i-1].rows * mPyramidScale));
+            // the pyramids only live during the patch match, put them in the frame arena
+            FrameArena* pArena = FrameArena::GetThreadLocal();
+            const cv::Size sz1(mvImgPyr1[i-1].cols * mPyramidScale, mvImgPyr1[i-1].rows * mPyramidScale);
+            const cv::Size sz2(mvImgPyr2[i-1].cols * mPyramidScale, mvImgPyr2[i-1].rows * mPyramidScale);
+            cv::Mat img1_pyr(sz1, mvImgPyr1[i-1].type(), pArena->Allocate(sz1.area() * mvImgPyr1[i-1].elemSize(), 16));
+            cv::Mat img2_pyr(sz2, mvImgPyr2[i-1].type(), pArena->Allocate(sz2.area() * mvImgPyr2[i-1].elemSize(), 16));
+            cv::resize(mvImgPyr1[i-1], img1_pyr, sz1);
+            cv::resize(mvImgPyr2[i-1], img2_pyr, sz2);
             mvImgPyr1.push_back(img1_pyr);
             mvImgPyr2.push_back(img2_pyr);
             mvScales.push_back(mvScales[i-1] * mPyramidScale);
@@ -77,59 +85,56 @@ void PatchMatch::CreatePyramids(){
 
 // Multi level optical flow tracking
 void PatchMatch::OpticalFlowMultiLevel(){
+    TRACE_SCOPE("OpticalFlowMultiLevel");
     CreatePyramids();
 
     // Set initial points for top pyramid
-    for (size_t i = 0; i < mN; i++) {
-        mvPtPyr1Un.push_back(mpMatcher->mvKeysRefUn[i].pt);
-        if (mbHasGyroPredictInitial)
-            mvPtPyr2Un.push_back(mpMatcher->mvPtPredictUn[i]);
-        else {
-            mvPtPyr2Un.push_back(mpMatcher->mvKeysRefUn[i].pt);
-        }
+    FeatureTable &f = mFeatures;
+    if (mbHasGyroPredictInitial) {
+        f.uMatchUn = f.uPredUn;
+        f.vMatchUn = f.vPredUn;
+    }
+    else {
+        f.uMatchUn = f.uRef;
+        f.vMatchUn = f.vRef;
     }
 
     // coarse-to-fine LK tracking in pyramids
-    mvSuccess.clear(); mvSuccess.resize(mN);
-    mvPixelErrorsOfPatchMatched.clear(); mvPixelErrorsOfPatchMatched.resize(mN);
-    mvNcc.clear(); mvNcc.resize(mN);
+    f.matched.Clear();
 
     //const float pyramidScale_inv = 1.0 / mPyramidScale;
     for (int level = mPyramids - 1; level >= 0; level --) {
         mLevel = level;
-        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        TRACE_SCOPE_ARG("OpticalFlowLevel", level);
 
-        // use opencv parallel_for_ function
-        cv::parallel_for_(cv::Range(0,mN), [&](const cv::Range& range){
+        // use opencv parallel_for_ function. Split the features in blocks, so that each thread owns its words of f.matched
+        cv::parallel_for_(cv::Range(0,f.NumBlocks()), [&](const cv::Range& blocks){
+            STAGE_SCOPE("klt");
+            const cv::Range range = f.BlockToFeatures(blocks);
             for (auto i = range.start; i < range.end; i++)
                 OpticalFlowConsideringIlluminationChange_onePixel(i,
                                                                   mbConsiderIllumination,
                                                                   mbConsiderAffineDeformation,
                                                                   mbRegularizationPenalty);
         });
-
-        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
-        double t = std::chrono::duration_cast<std::chrono::duration<double> >(t2 - t1).count();
     }
 
     // Distort
     DistortPoints();
 
-    // Set mpMatcher
-    SetMatcher();
-
     // Display
     /*
     cv::Mat img2_multi;
     cv::cvtColor(mvImgPyr1[0], img2_multi, CV_GRAY2BGR);
-    for (int i = 0; i < mvPtPyr2Un.size(); i ++) {
-        if (mvSuccess[i])
+    for (int i = 0; i < mN; i ++) {
+        if (f.matched.Test(i))
         {
-            cv::circle(img2_multi, mpMatcher->mvPtPredict[i], 2, cv::Scalar(255, 0, 0), -1);    // blue, predict
-            cv::circle(img2_multi, mvPtPyr2Un[i], 2, cv::Scalar(0, 140, 255), -1);  //DarkOrange, optical flow
+            cv::Point2f pt_ref(f.uRef[i], f.vRef[i]), pt_pred(f.uPred[i], f.vPred[i]), pt_match(f.uMatchUn[i], f.vMatchUn[i]);
+            cv::circle(img2_multi, pt_pred, 2, cv::Scalar(255, 0, 0), -1);    // blue, predict
+            cv::circle(img2_multi, pt_match, 2, cv::Scalar(0, 140, 255), -1);  //DarkOrange, optical flow
 
-            cv::line(img2_multi, mvPtPyr1Un[i], mpMatcher->mvPtPredict[i], cv::Scalar(255, 255, 255), 1); // white: reference to predict
-            cv::line(img2_multi, mpMatcher->mvPtPredict[i], mvPtPyr2Un[i], cv::Scalar(0, 0, 255), 1); // red: predict to optical flow
+            cv::line(img2_multi, pt_ref, pt_pred, cv::Scalar(255, 255, 255), 1); // white: reference to predict
+            cv::line(img2_multi, pt_pred, pt_match, cv::Scalar(0, 0, 255), 1); // red: predict to optical flow
         }
     }
     if (mpMatcher->mType == GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED)
@@ -170,16 +175,22 @@ void PatchMatch::OpticalFlowConsideringIlluminationChange_onePixel(
         const bool bConsiderAffineDeformation,
         const bool bRegularizationPenalty)
 {
-    if (!mvGyroPredictStatus[i])
+    FeatureTable &f = mFeatures;
+    if (!f.predicted.Test(i))
         return;
 
+    // all the scratch buffers of this feature are released at the end of the function
+    ArenaScope scope;
+
     // Use distorted points to perform the patch match on raw image
-    cv::Point2f pt = mvPtPyr1Un[i] * mvScales[mLevel]; // (float)(1./(1<<mLevel));
+    const cv::Point2f ptRef(f.uRef[i], f.vRef[i]);
+    const cv::Point2f ptMatch(f.uMatchUn[i], f.vMatchUn[i]);
+    cv::Point2f pt = ptRef * mvScales[mLevel]; // (float)(1./(1<<mLevel));
     cv::Point2f nextPt;
     if (mLevel == mPyramids - 1){
-        nextPt = mvPtPyr2Un[i] * mvScales[mLevel]; // initial for points on the top level
+        nextPt = ptMatch * mvScales[mLevel]; // initial for points on the top level
     }else {
-        nextPt = mvPtPyr2Un[i] * 1.0f / mPyramidScale; //2.0f;    // initial for points on the next level
+        nextPt = ptMatch * 1.0f / mPyramidScale; //2.0f;    // initial for points on the next level
     }
 
     // dx, dy need to be estimated.
@@ -194,14 +205,15 @@ void PatchMatch::OpticalFlowConsideringIlluminationChange_onePixel(
     bool succ = true;   // indicate if this point succeeded
 
     // calculate the warp patch (i.e., affine deformation patch)
-    cv::Mat warp_patch(cv::Size(mHalfPatchSize*2+1, mHalfPatchSize*2+1), CV_32FC2);
+    const int patchSize = mHalfPatchSize*2+1;
+    cv::Mat warp_patch(cv::Size(patchSize, patchSize), CV_32FC2,
+                       scope.GetArena()->Allocate(patchSize * patchSize * sizeof(Vec2f), alignof(Vec2f)));
     if (bConsiderAffineDeformation) {
-        cv::Mat A = mpMatcher->mvAffineDeformationMatrix[i];
-        assert(A.empty() == false);
+        const float a11 = f.a11[i], a12 = f.a12[i], a21 = f.a21[i], a22 = f.a22[i];
         for (int x = - mHalfPatchSize; x <= mHalfPatchSize; x ++) {
             for (int y = - mHalfPatchSize; y <= mHalfPatchSize; y++) {
-                float wx = A.at<float>(0,0) * x + A.at<float>(0,1) * y;
-                float wy = A.at<float>(1,0) * x + A.at<float>(1,1) * y;
+                float wx = a11 * x + a12 * y;
+                float wy = a21 * x + a22 * y;
                 warp_patch.at<Vec2f>(x + mHalfPatchSize, y + mHalfPatchSize)[0] = wx;
                 warp_patch.at<Vec2f>(x + mHalfPatchSize, y + mHalfPatchSize)[1] = wy;
             }
@@ -222,14 +234,15 @@ void PatchMatch::OpticalFlowConsideringIlluminationChange_onePixel(
         }
 
         // try to compute cost and jacobian in multi-thread
+        ArenaScope iterScope;
         int N_index = (2 * mHalfPatchSize + 1) * (2 * mHalfPatchSize + 1);
-        vector<Eigen::Vector4d> vJ; vJ.resize(N_index);
-        vector<float> vE; vE.resize(N_index);
-        vector<bool> vFlag(N_index, false);
+        ArenaVector<Eigen::Vector4d> vJ; vJ.resize(N_index);
+        ArenaVector<float> vE; vE.resize(N_index);
+        ArenaVector<bool> vFlag(N_index, false);
         int index = 0;
 
-        vector<cv::Point2f> vPt_x_y; vPt_x_y.resize(N_index);
-        vector<cv::Point2f> vPt_wx_wy; vPt_wx_wy.resize(N_index);
+        ArenaVector<cv::Point2f> vPt_x_y; vPt_x_y.resize(N_index);
+        ArenaVector<cv::Point2f> vPt_wx_wy; vPt_wx_wy.resize(N_index);
         for (int y = - mHalfPatchSize; y <= mHalfPatchSize; y ++) {
             for (int x = - mHalfPatchSize; x <= mHalfPatchSize; x++) {
                 float wx = x, wy = y;
@@ -345,45 +358,24 @@ void PatchMatch::OpticalFlowConsideringIlluminationChange_onePixel(
 
     } // end for: iter \in [0, iterations)
 
-    mvPtPyr2Un[i] = pt + cv::Point2f(dx, dy);
+    f.uMatchUn[i] = pt.x + dx;
+    f.vMatchUn[i] = pt.y + dy;
 
     if (mLevel == 0){
-        mvSuccess[i] = succ;
-        mvPixelErrorsOfPatchMatched[i] = std::sqrt(lastCost * mWinSizeInv);
+        if (succ)
+            f.matched.Set(i);
+        else
+            f.matched.Reset(i);
+        f.error[i] = std::sqrt(lastCost * mWinSizeInv);
     }
 
     // calculate zero-normilized cross correlation
     if(mbCalculateNCC){
-        if (bConsiderAffineDeformation){
-            mvNcc[i] = NCC(mHalfPatchSize, mpMatcher->mImgGrayRef, mpMatcher->mImgGrayCur,
-                           mvPtPyr1Un[i],  mvPtPyr2Un[i], mpMatcher->mvAffineDeformationMatrix[i]);
-        }else {
-            mvNcc[i] = NCC(mHalfPatchSize, mpMatcher->mImgGrayRef, mpMatcher->mImgGrayCur,
-                           mvPtPyr1Un[i],  mvPtPyr2Un[i], cv::Mat());
-        }
+        const cv::Point2f ptCur(f.uMatchUn[i], f.vMatchUn[i]);
+        f.ncc[i] = NCC(mHalfPatchSize, mpMatcher->mImgGrayRef, mpMatcher->mImgGrayCur, ptRef, ptCur,
+                       bConsiderAffineDeformation? f.Affine(i): cv::Matx22f::eye());
     }else {
-        mvNcc[i] = 1;
-    }
-}
-
-// Set mpMatcher
-void PatchMatch::SetMatcher()
-{
-    mpMatcher->mvPtPredictAfterPatchMatched.resize(mN);
-    mpMatcher->mvPtPredictAfterPatchMatchedUn.resize(mN);
-    mpMatcher->mvStatusAfterPatchMatched.resize(mN);
-    mpMatcher->mvPixelErrorsOfPatchMatched.resize(mN);
-    mpMatcher->mvDistanceBetweenPredictedAndPatchMatched.resize(mN);
-    mpMatcher->mvNccAfterPatchMatched.resize(mN);
-    for (size_t i = 0; i < mN; i ++){
-        mpMatcher->mvPtPredictAfterPatchMatched[i] = mvPtPyr2[i];
-        mpMatcher->mvPtPredictAfterPatchMatchedUn[i] = mvPtPyr2Un[i];
-        mpMatcher->mvStatusAfterPatchMatched[i] = mvSuccess[i];
-        mpMatcher->mvPixelErrorsOfPatchMatched[i] = mvPixelErrorsOfPatchMatched[i];
-
-        cv::Point2f pt_dist = mpMatcher->mvPtPredictUn[i] - mvPtPyr2Un[i];
-        mpMatcher->mvDistanceBetweenPredictedAndPatchMatched[i] = std::sqrt(pt_dist.x * pt_dist.x + pt_dist.y * pt_dist.y);
-        mpMatcher->mvNccAfterPatchMatched[i] = mvNcc[i];
+        f.ncc[i] = 1;
     }
 }
 
@@ -407,11 +399,28 @@ inline float PatchMatch::GetPixelValue(const cv::Mat &img, float x, float y) con
 
 
 void PatchMatch::DistortPoints(){
-    if (mpMatcher->mDistCoef.at<float>(0) == 0.0)
-        mvPtPyr2 = mvPtPyr2Un;
-    else {
-        mvPtPyr2.resize(mN);
-        DistortVecPoints(mvPtPyr2Un, mvPtPyr2, mpMatcher->mK, mpMatcher->mDistCoef);
+    FeatureTable &f = mFeatures;
+    if (mpMatcher->mDistCoef.at<float>(0) == 0.0) {
+        f.uMatch = f.uMatchUn;
+        f.vMatch = f.vMatchUn;
+        return;
+    }
+
+    const float fx = mpMatcher->mfx, fy = mpMatcher->mfy, cx = mpMatcher->mcx, cy = mpMatcher->mcy;
+    const float fx_inv = mpMatcher->mfx_inv, fy_inv = mpMatcher->mfy_inv;
+    const float k1 = mpMatcher->mk1, k2 = mpMatcher->mk2, k3 = mpMatcher->mk3;
+    const float p1 = mpMatcher->mp1, p2 = mpMatcher->mp2;
+    for (size_t i = 0; i < mN; i++) {
+        float x = (f.uMatchUn[i] - cx) * fx_inv;
+        float y = (f.vMatchUn[i] - cy) * fy_inv;
+
+        float r2 = x * x + y * y;
+        float r4 = r2 * r2;
+        float r6 = r4 * r2;
+        float x_distort = x * (1 + k1 * r2 + k2 * r4 + k3 * r6) + 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+        float y_distort = y * (1 + k1 * r2 + k2 * r4 + k3 * r6) + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+        f.uMatch[i] = fx * x_distort + cx;
+        f.vMatch[i] = fy * y_distort + cy;
     }
 }
 
@@ -430,11 +439,14 @@ void PatchMatch::DistortPoints(){
  *             sqrt( \Sigma_{i,j}(A(i,j) - \bar{A}(i,j))^2 \cdot \Sigma_{i,j}(B(i,j) - \bar{B}(i,j))^2 )
  *
  */
-float PatchMatch::NCC(int halfPathSize, const cv::Mat &ref, const cv::Mat &cur, const cv::Point2f &pt_ref, const cv::Point2f &pt_cur, const cv::Mat &warp_mat)
+float PatchMatch::NCC(int halfPathSize, const cv::Mat &ref, const cv::Mat &cur, const cv::Point2f &pt_ref, const cv::Point2f &pt_cur, const cv::Matx22f &warp_mat)
 {
     // First: calculate mean value
     float mean_ref = 0.0f, mean_cur = 0.0f;
-    std::vector<float> vValuesRef, vValuesCur;
+    ArenaScope scope;
+    ArenaVector<float> vValuesRef, vValuesCur;
+    vValuesRef.reserve((2 * halfPathSize + 1) * (2 * halfPathSize + 1));
+    vValuesCur.reserve((2 * halfPathSize + 1) * (2 * halfPathSize + 1));
     for (int x = -halfPathSize; x <= halfPathSize; x++)
         for (int y = -halfPathSize; y <= halfPathSize; y++) {
             float value_ref = GetPixelValue(ref, pt_ref.x + x, pt_ref.y + y);
@@ -442,14 +454,9 @@ float PatchMatch::NCC(int halfPathSize, const cv::Mat &ref, const cv::Mat &cur,
             vValuesRef.push_back(value_ref);
 
             // consider the affine deformation matrix
-            float value_cur = 0;
-            if (warp_mat.empty())
-                value_cur = GetPixelValue(cur, pt_cur.x + x, pt_cur.y + y);
-            else {
-                float wx = warp_mat.at<float>(0,0) * x + warp_mat.at<float>(0,1) * y;
-                float wy = warp_mat.at<float>(1,0) * x + warp_mat.at<float>(1,1) * y;
-                value_cur = GetPixelValue(cur, pt_cur.x + wx, pt_cur.y + wy);
-            }
+            float wx = warp_mat(0,0) * x + warp_mat(0,1) * y;
+            float wy = warp_mat(1,0) * x + warp_mat(1,1) * y;
+            float value_cur = GetPixelValue(cur, pt_cur.x + wx, pt_cur.y + wy);
             mean_cur += value_cur;
             vValuesCur.push_back(value_cur);
         }
@@ -0,0 +1,244 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "perf_counters.h"
+
+#if defined(ENABLE_PERF_COUNTERS) && defined(__linux__)
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "metrics.h"
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+namespace {
+
+const uint64_t EVENT_CONFIGS[PerfCounters::EVENT_NUM] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// Counters of one stage. Accumulated from all the threads.
+struct sStage
+{
+    const char* name;
+    std::atomic<uint64_t> vFrame[PerfCounters::EVENT_NUM];  // since the last EndFrame()
+    std::atomic<uint64_t> vTotal[PerfCounters::EVENT_NUM];
+    Histogram *pIPC, *pLLCMPKI, *pBranchMPKI;
+};
+
+sStage gvStages[PerfCounters::MAX_STAGES];
+std::atomic<int> gnStages(0);
+std::mutex gMutexStages;
+std::atomic<bool> gbUnavailable(false);
+
+// The perf_event_open group of one thread
+struct ThreadGroup
+{
+    ThreadGroup(): fdLeader(-1), nOpened(0), bTried(false)
+    {
+        for(int i = 0; i < PerfCounters::EVENT_NUM; i++){
+            vFds[i] = -1;
+            vSlots[i] = -1;
+        }
+    }
+    ~ThreadGroup()
+    {
+        for(int i = 0; i < PerfCounters::EVENT_NUM; i++)
+            if(vFds[i] >= 0) close(vFds[i]);
+    }
+
+    bool Open();
+
+    int fdLeader;
+    int vFds[PerfCounters::EVENT_NUM];
+    int vSlots[PerfCounters::EVENT_NUM];    // position of the event in the group read, -1 if not opened
+    int nOpened;
+    bool bTried;
+};
+
+int PerfEventOpen(perf_event_attr &attr, int groupFd)
+{
+    // pid = 0, cpu = -1: the calling thread on any cpu
+    return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+int ReadParanoid()
+{
+    std::ifstream fp("/proc/sys/kernel/perf_event_paranoid");
+    int level = -100;
+    if(fp.is_open()) fp >> level;
+    return level;
+}
+
+bool ThreadGroup::Open()
+{
+    bTried = true;
+    for(int i = 0; i < PerfCounters::EVENT_NUM; i++){
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EVENT_CONFIGS[i];
+        attr.disabled = fdLeader < 0? 1: 0;
+        attr.exclude_kernel = 1;    // allowed with perf_event_paranoid <= 2
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        const int fd = PerfEventOpen(attr, fdLeader);
+        if(fd < 0){
+            if(fdLeader < 0){
+                // Without the cycles counter nothing can be reported, disable the counters of all the threads
+                if(!gbUnavailable.exchange(true))
+                    LOG(WARNING) << "perf_event_open failed (" << strerror(errno) << ", perf_event_paranoid = " << ReadParanoid()
+                                 << "), the hardware performance counters are disabled";
+                return false;
+            }
+            LOG(WARNING) << "perf_event_open: event " << i << " is not available (" << strerror(errno) << ")";
+            continue;
+        }
+        if(fdLeader < 0) fdLeader = fd;
+        vFds[i] = fd;
+        vSlots[i] = nOpened++;
+    }
+
+    ioctl(fdLeader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fdLeader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+}
+
+ThreadGroup& GetThreadGroup()
+{
+    static thread_local ThreadGroup group;
+    return group;
+}
+
+std::string SafeName(const char* name)
+{
+    std::string s(name);
+    for(size_t i = 0; i < s.size(); i++)
+        if(!isalnum(s[i])) s[i] = '_';
+    return s;
+}
+
+} // namespace
+
+int PerfCounters::RegisterStage(const char* name)
+{
+    std::unique_lock<std::mutex> lock(gMutexStages);
+    const int n = gnStages.load();
+    for(int i = 0; i < n; i++)
+        if(strcmp(gvStages[i].name, name) == 0)
+            return i;
+    if(n >= MAX_STAGES)
+        return -1;
+
+    sStage &stage = gvStages[n];
+    stage.name = name;
+    for(int i = 0; i < EVENT_NUM; i++){
+        stage.vFrame[i] = 0;
+        stage.vTotal[i] = 0;
+    }
+    const std::string prefix = "perf_" + SafeName(name);
+    MetricsRegistry* pRegistry = MetricsRegistry::GetInstance();
+    stage.pIPC = pRegistry->GetHistogram(prefix + "_ipc", std::string("Instructions per cycle of ") + name + " per frame", 1e3);
+    stage.pLLCMPKI = pRegistry->GetHistogram(prefix + "_llc_mpki", std::string("LLC misses per kilo instructions of ") + name + " per frame", 1e3);
+    stage.pBranchMPKI = pRegistry->GetHistogram(prefix + "_branch_mpki", std::string("Branch misses per kilo instructions of ") + name + " per frame", 1e3);
+    gnStages = n + 1;
+    return n;
+}
+
+bool PerfCounters::Read(sValues &values)
+{
+    if(gbUnavailable.load(std::memory_order_relaxed))
+        return false;
+    ThreadGroup &group = GetThreadGroup();
+    if(!group.bTried && !group.Open())
+        return false;
+    if(group.fdLeader < 0)
+        return false;
+
+    // nr, time_enabled, time_running, values[nr]
+    uint64_t buf[3 + EVENT_NUM];
+    if(read(group.fdLeader, buf, sizeof(buf)) < ssize_t((3 + group.nOpened) * sizeof(uint64_t)))
+        return false;
+
+    // Scale when the group was multiplexed with other events
+    const double scale = buf[2] > 0? double(buf[1]) / buf[2]: 1.0;
+    for(int i = 0; i < EVENT_NUM; i++)
+        values.v[i] = group.vSlots[i] < 0? 0: uint64_t(buf[3 + group.vSlots[i]] * scale);
+    return true;
+}
+
+void PerfCounters::Accumulate(int stage, const sValues &begin, const sValues &end)
+{
+    sStage &s = gvStages[stage];
+    for(int i = 0; i < EVENT_NUM; i++){
+        const uint64_t d = end.v[i] > begin.v[i]? end.v[i] - begin.v[i]: 0;
+        s.vFrame[i].fetch_add(d, std::memory_order_relaxed);
+        s.vTotal[i].fetch_add(d, std::memory_order_relaxed);
+    }
+}
+
+void PerfCounters::EndFrame()
+{
+    const int n = gnStages.load();
+    for(int k = 0; k < n; k++){
+        sStage &s = gvStages[k];
+        uint64_t v[EVENT_NUM];
+        for(int i = 0; i < EVENT_NUM; i++)
+            v[i] = s.vFrame[i].exchange(0, std::memory_order_relaxed);
+        if(v[CYCLES] == 0 || v[INSTRUCTIONS] == 0)
+            continue;   // the stage did not run in this frame
+        s.pIPC->Record(double(v[INSTRUCTIONS]) / v[CYCLES]);
+        s.pLLCMPKI->Record(1e3 * v[LLC_MISSES] / v[INSTRUCTIONS]);
+        s.pBranchMPKI->Record(1e3 * v[BRANCH_MISSES] / v[INSTRUCTIONS]);
+    }
+}
+
+void PerfCounters::Report()
+{
+    const int n = gnStages.load();
+    for(int k = 0; k < n; k++){
+        const sStage &s = gvStages[k];
+        const double cycles = s.vTotal[CYCLES], instructions = s.vTotal[INSTRUCTIONS];
+        if(cycles == 0 || instructions == 0)
+            continue;
+        LOG(INFO) << std::fixed << std::setprecision(3) << "perf " << s.name
+                  << ": cycles " << cycles << ", instructions " << instructions
+                  << ", IPC " << instructions / cycles
+                  << ", LLC MPKI " << 1e3 * s.vTotal[LLC_MISSES] / instructions
+                  << ", branch MPKI " << 1e3 * s.vTotal[BRANCH_MISSES] / instructions;
+    }
+}
+
+#endif // ENABLE_PERF_COUNTERS
@@ -0,0 +1,191 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "result_sink.h"
+#include <sys/stat.h>
+#include <errno.h>
+#include <iomanip>
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+namespace {
+
+const char* RECORD_NAMES[ResultSink::RECORD_TYPE_NUM] = {
+    "trackFeatures", "timeCost", "ORBDetectAndDespMatch"
+};
+
+const char* RECORD_COLUMNS[ResultSink::RECORD_TYPE_NUM] = {
+    "t,ref_key_num,predict_num,geo_valid_num,pred_suc_rate,track_rate,imu_num,track_score,recall_rate",
+    "t,total_feature_track,gyro_predict,opt_flow,opt_flow_result_filter_out,geometry_validation",
+    "t,ref_key_num,descriptor_match_num,filter_out_distance_num"
+};
+
+// Equal to "mkdir -p", without spawning a shell
+bool MakeDirectories(const std::string &path)
+{
+    for(size_t pos = 1; pos <= path.size(); pos++){
+        if(pos != path.size() && path[pos] != '/')
+            continue;
+        const std::string dir = path.substr(0, pos);
+        if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::mutex ResultSink::mMutexSinks;
+std::map<std::string, std::unique_ptr<ResultSink> > ResultSink::mmSinks;
+
+ResultSink::ResultSink(const std::string &saveFolderPath, eFormat format, size_t capacity):
+    mSaveFolderPath(saveFolderPath), mFormat(format), mQueue(capacity), mnDropped(0), mbStop(false), mbWaiting(false)
+{
+    if(!MakeDirectories(mSaveFolderPath))
+        LOG(ERROR) << "cannot create: " << mSaveFolderPath;
+
+    for(int i = 0; i < RECORD_TYPE_NUM; i++){
+        std::string filename = mSaveFolderPath + RECORD_NAMES[i] + (mFormat == BINARY? ".bin": ".csv");
+        if(mFormat == BINARY)
+            mvFiles[i].open(filename.c_str(), std::ofstream::app | std::ofstream::binary);
+        else{
+            mvFiles[i].open(filename.c_str(), std::ofstream::app);
+            mvFiles[i] << std::fixed << std::setprecision(6);
+            if(mvFiles[i].is_open() && mvFiles[i].tellp() == 0)
+                mvFiles[i] << RECORD_COLUMNS[i] << "\n";
+        }
+        if(!mvFiles[i].is_open())
+            LOG(ERROR) << "cannot open: " << filename;
+    }
+
+    mThread = std::thread(&ResultSink::Run, this);
+}
+
+ResultSink::~ResultSink()
+{
+    mbStop = true;
+    {
+        std::unique_lock<std::mutex> lock(mMutexWait);
+        mCondition.notify_one();
+    }
+    mThread.join();
+
+    if(mnDropped > 0)
+        LOG(WARNING) << "ResultSink " << mSaveFolderPath << ": dropped " << mnDropped << " records";
+}
+
+bool ResultSink::Push(eRecordType type, double t, const float *values, int n)
+{
+    sRecord record;
+    record.t = t;
+    record.type = type;
+    record.n = std::min(n, int(MAX_VALUES));
+    for(int i = 0; i < MAX_VALUES; i++)
+        record.values[i] = i < record.n? values[i]: 0.0f;
+
+    if(!mQueue.TryPush(record)){
+        mnDropped ++;
+        return false;
+    }
+
+    // Wake up the writer only if it sleeps, the pushes to a busy writer do not take the lock.
+    // The fence pairs with the one in Run(): either the writer sees the record, or this thread sees mbWaiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(mbWaiting.load(std::memory_order_relaxed)){
+        std::unique_lock<std::mutex> lock(mMutexWait);
+        mCondition.notify_one();
+    }
+    return true;
+}
+
+void ResultSink::Run()
+{
+    sRecord record;
+    bool bFlushed = true;
+    while(true)
+    {
+        if(mQueue.TryPop(record)){
+            Write(record);
+            bFlushed = false;
+            continue;
+        }
+
+        // The queue is empty, flush and wait for new records
+        if(!bFlushed){
+            for(int i = 0; i < RECORD_TYPE_NUM; i++)
+                mvFiles[i].flush();
+            bFlushed = true;
+            continue;
+        }
+        if(mbStop)
+            return;
+
+        std::unique_lock<std::mutex> lock(mMutexWait);
+        mbWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!mbStop && mQueue.IsEmpty())
+            mCondition.wait(lock);
+        mbWaiting.store(false, std::memory_order_relaxed);
+    }
+}
+
+void ResultSink::Write(const sRecord &record)
+{
+    if(record.type < 0 || record.type >= RECORD_TYPE_NUM)
+        return;
+    std::ofstream &fp = mvFiles[record.type];
+    if(!fp.is_open())
+        return;
+
+    if(mFormat == BINARY){
+        fp.write(reinterpret_cast<const char*>(&record), sizeof(sRecord));
+    }
+    else{
+        fp << record.t;
+        for(int i = 0; i < record.n; i++)
+            fp << "," << record.values[i];
+        fp << "\n";
+    }
+}
+
+ResultSink* ResultSink::Create(const std::string &saveFolderPath, eFormat format)
+{
+    if(saveFolderPath.empty())
+        return NULL;
+
+    std::unique_lock<std::mutex> lock(mMutexSinks);
+    std::unique_ptr<ResultSink> &pSink = mmSinks[saveFolderPath];
+    if(!pSink)
+        pSink.reset(new ResultSink(saveFolderPath, format));
+    return pSink.get();
+}
+
+ResultSink* ResultSink::Get(const std::string &saveFolderPath)
+{
+    // the sinks live until the exit, the cached pointer stays valid
+    static thread_local ResultSink* pLastSink = NULL;
+    if(pLastSink && pLastSink->mSaveFolderPath == saveFolderPath)
+        return pLastSink;
+
+    pLastSink = Create(saveFolderPath, CSV);
+    return pLastSink;
+}
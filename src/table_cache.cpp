@@ -0,0 +1,170 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "table_cache.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+namespace {
+
+const char MAGIC[8] = "TBCACHE";
+const uint32_t VERSION = 1;
+const size_t ALIGNMENT = 64;
+
+size_t Align(size_t n)
+{
+    return (n + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+size_t TableBytes(const TableCache::sTable &table)
+{
+    return size_t(table.rows) * table.cols * CV_ELEM_SIZE(table.type);
+}
+
+} // namespace
+
+TableCache::TableCache():
+    mpData(NULL), mnSize(0), mpHeader(NULL), mpTables(NULL)
+{
+}
+
+TableCache::~TableCache()
+{
+    Close();
+}
+
+void TableCache::Close()
+{
+    if(mpData)
+        munmap(mpData, mnSize);
+    mpData = NULL;
+    mnSize = 0;
+    mpHeader = NULL;
+    mpTables = NULL;
+}
+
+bool TableCache::Open(const std::string &path, uint64_t hash)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(sHeader)){
+        close(fd);
+        return false;
+    }
+
+    void* pData = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping stays valid
+    if(pData == MAP_FAILED)
+        return false;
+
+    // the hash differs when the calibration or the resolution changed: the caller rebuilds the tables
+    const sHeader* pHeader = static_cast<const sHeader*>(pData);
+    bool bValid = memcmp(pHeader->magic, MAGIC, sizeof(MAGIC)) == 0 && pHeader->version == VERSION
+            && pHeader->hash == hash
+            && sizeof(sHeader) + size_t(pHeader->nTables) * sizeof(sTable) <= size_t(st.st_size);
+    const sTable* pTables = reinterpret_cast<const sTable*>(pHeader + 1);
+    for(uint32_t i = 0; bValid && i < pHeader->nTables; i++)
+        bValid = pTables[i].rows >= 0 && pTables[i].cols >= 0 && pTables[i].offset % ALIGNMENT == 0
+                && pTables[i].offset + TableBytes(pTables[i]) <= size_t(st.st_size);
+    if(!bValid){
+        munmap(pData, st.st_size);
+        return false;
+    }
+
+    mpData = pData;
+    mnSize = st.st_size;
+    mpHeader = pHeader;
+    mpTables = pTables;
+    return true;
+}
+
+cv::Mat TableCache::GetTable(int idx) const
+{
+    const sTable &table = mpTables[idx];
+    return cv::Mat(table.rows, table.cols, table.type, static_cast<char*>(mpData) + table.offset);
+}
+
+bool TableCache::Save(const std::string &path, uint64_t hash, const std::vector<cv::Mat> &vTables)
+{
+    sHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.nTables = vTables.size();
+    header.hash = hash;
+
+    std::vector<sTable> vEntries(vTables.size());
+    size_t offset = Align(sizeof(sHeader) + vEntries.size() * sizeof(sTable));
+    for(size_t i = 0; i < vTables.size(); i++){
+        vEntries[i].rows = vTables[i].rows;
+        vEntries[i].cols = vTables[i].cols;
+        vEntries[i].type = vTables[i].type();
+        vEntries[i].reserved = 0;
+        vEntries[i].offset = offset;
+        offset = Align(offset + TableBytes(vEntries[i]));
+    }
+
+    // write to a temporary file, then rename, so that a partial file is never opened
+    const std::string tmp = path + ".tmp";
+    std::ofstream fout(tmp.c_str(), std::ios::binary);
+    if(!fout.is_open()){
+        LOG(ERROR) << "open file failed. file: " << tmp;
+        return false;
+    }
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if(!vEntries.empty())
+        fout.write(reinterpret_cast<const char*>(vEntries.data()), vEntries.size() * sizeof(sTable));
+    for(size_t i = 0; i < vTables.size(); i++){
+        const std::vector<char> vPad(vEntries[i].offset - size_t(fout.tellp()), 0);
+        fout.write(vPad.data(), vPad.size());
+        const size_t rowBytes = vTables[i].cols * vTables[i].elemSize();
+        for(int r = 0; r < vTables[i].rows; r++)
+            fout.write(vTables[i].ptr<char>(r), rowBytes);
+    }
+    fout.close();
+    if(!fout || rename(tmp.c_str(), path.c_str()) != 0){
+        LOG(ERROR) << "write file failed. file: " << path;
+        return false;
+    }
+    return true;
+}
+
+uint64_t TableCache::Hash(const void* pData, size_t n, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(pData);
+    uint64_t hash = seed;
+    for(size_t i = 0; i < n; i++){
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
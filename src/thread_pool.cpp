@@ -0,0 +1,101 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace {
+
+// The pool running the calling thread, NULL out of the workers
+thread_local ThreadPool* tpCurrentPool = NULL;
+
+} // namespace
+
+ThreadPool::ThreadPool(int nThreads): mbStop(false)
+{
+    nThreads = std::max(1, nThreads);
+    mvWorkers.reserve(nThreads);
+    for(int i = 0; i < nThreads; i++)
+        mvWorkers.push_back(std::thread(&ThreadPool::Run, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mbStop = true;
+    }
+    mCondition.notify_all();
+    for(size_t i = 0; i < mvWorkers.size(); i++)
+        mvWorkers[i].join();
+}
+
+std::future<void> ThreadPool::Enqueue(const std::function<void()> &task)
+{
+    std::packaged_task<void()> packagedTask(task);
+    std::future<void> future = packagedTask.get_future();
+    if(IsWorkerThread()){
+        packagedTask();
+        return future;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mqTasks.push(std::move(packagedTask));
+    }
+    mCondition.notify_one();
+    return future;
+}
+
+bool ThreadPool::IsWorkerThread() const
+{
+    return tpCurrentPool == this;
+}
+
+void ThreadPool::Run()
+{
+    tpCurrentPool = this;
+    while(true)
+    {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            while(!mbStop && mqTasks.empty())
+                mCondition.wait(lock);
+
+            // Finish the queued tasks before stopping
+            if(mqTasks.empty())
+                return;
+
+            task = std::move(mqTasks.front());
+            mqTasks.pop();
+        }
+        task();
+    }
+}
+
+ThreadPool* ThreadPool::GetInstance()
+{
+    static ThreadPool pool(std::max(2, int(std::thread::hardware_concurrency())));
+    return &pool;
+}
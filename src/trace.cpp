@@ -0,0 +1,141 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "trace.h"
+
+#ifdef ENABLE_TRACING
+
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+
+struct sTraceEvent
+{
+    const char* name;
+    int64_t tBegin;
+    int64_t tEnd;
+    int arg;
+};
+
+// Events of one thread. The mutex is only contended while exporting.
+struct ThreadBuffer
+{
+    static const size_t MAX_EVENTS = 1 << 20;
+
+    explicit ThreadBuffer(int tid_): tid(tid_), nDropped(0) {vEvents.reserve(4096);}
+
+    int tid;
+    size_t nDropped;
+    std::mutex mutex;
+    std::vector<sTraceEvent> vEvents;
+};
+
+// The buffers are owned here so that the events of the exited threads are kept
+std::mutex gMutexBuffers;
+std::vector<std::unique_ptr<ThreadBuffer> > gvBuffers;
+
+ThreadBuffer* GetThreadBuffer()
+{
+    static thread_local ThreadBuffer* pBuffer = NULL;
+    if(!pBuffer){
+        std::unique_lock<std::mutex> lock(gMutexBuffers);
+        gvBuffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(gvBuffers.size())));
+        pBuffer = gvBuffers.back().get();
+    }
+    return pBuffer;
+}
+
+void WriteEscaped(std::ofstream &fp, const char* s)
+{
+    for(; *s; s++){
+        if(*s == '"' || *s == '\\') fp << '\\';
+        fp << *s;
+    }
+}
+
+} // namespace
+
+void Tracer::Record(const char* name, int64_t tBegin, int64_t tEnd, int arg)
+{
+    ThreadBuffer* pBuffer = GetThreadBuffer();
+    std::unique_lock<std::mutex> lock(pBuffer->mutex);
+    if(pBuffer->vEvents.size() >= ThreadBuffer::MAX_EVENTS){
+        pBuffer->nDropped ++;
+        return;
+    }
+    sTraceEvent e = {name, tBegin, tEnd, arg};
+    pBuffer->vEvents.push_back(e);
+}
+
+bool Tracer::Export(const std::string &filename)
+{
+    std::ofstream fp(filename.c_str());
+    if(!fp.is_open())
+        return false;
+
+    std::unique_lock<std::mutex> lock(gMutexBuffers);
+
+    // Timestamps relative to the first event, in microseconds
+    int64_t tOrigin = INT64_MAX;
+    for(size_t k = 0; k < gvBuffers.size(); k++){
+        std::unique_lock<std::mutex> lockBuffer(gvBuffers[k]->mutex);
+        for(size_t i = 0; i < gvBuffers[k]->vEvents.size(); i++)
+            tOrigin = std::min(tOrigin, gvBuffers[k]->vEvents[i].tBegin);
+    }
+
+    fp << std::fixed;
+    fp.precision(3);
+    fp << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool bFirst = true;
+    for(size_t k = 0; k < gvBuffers.size(); k++){
+        ThreadBuffer* pBuffer = gvBuffers[k].get();
+        std::unique_lock<std::mutex> lockBuffer(pBuffer->mutex);
+
+        fp << (bFirst? "": ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << pBuffer->tid
+           << ",\"args\":{\"name\":\"thread " << pBuffer->tid << "\"}}";
+        bFirst = false;
+
+        for(size_t i = 0; i < pBuffer->vEvents.size(); i++){
+            const sTraceEvent &e = pBuffer->vEvents[i];
+            fp << ",\n{\"name\":\"";
+            WriteEscaped(fp, e.name);
+            fp << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << pBuffer->tid
+               << ",\"ts\":" << (e.tBegin - tOrigin) * 1e-3
+               << ",\"dur\":" << (e.tEnd - e.tBegin) * 1e-3;
+            if(e.arg >= 0)
+                fp << ",\"args\":{\"arg\":" << e.arg << "}";
+            fp << "}";
+        }
+        if(pBuffer->nDropped > 0)
+            fp << ",\n{\"name\":\"dropped events: " << pBuffer->nDropped << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":"
+               << pBuffer->tid << ",\"ts\":0}";
+    }
+    fp << "\n]}\n";
+    return true;
+}
+
+#endif // ENABLE_TRACING
@@ -0,0 +1,121 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "track_history.h"
+#include "frame.h"
+#include "trace.h"
+#include <algorithm>
+
+TrackHistory::TrackHistory(int nDepth, int nReserveTracks):
+    mnDepth(std::max(nDepth, 1)), mnStamp(0)
+{
+    nReserveTracks = std::max(nReserveTracks, 1);
+    mvSamples.reserve(size_t(nReserveTracks) * mnDepth);
+    mvHead.reserve(nReserveTracks);
+    mvLength.reserve(nReserveTracks);
+    mvSlotTrackId.reserve(nReserveTracks);
+    mvSlotStamp.reserve(nReserveTracks);
+    mvFreeSlots.reserve(nReserveTracks);
+    mmSlots.reserve(2 * nReserveTracks);
+}
+
+int TrackHistory::AcquireSlot(uint64_t nTrackId)
+{
+    int slot;
+    if(!mvFreeSlots.empty()){
+        slot = mvFreeSlots.back();
+        mvFreeSlots.pop_back();
+    }
+    else {
+        slot = mvHead.size();
+        mvSamples.resize(mvSamples.size() + mnDepth);
+        mvHead.push_back(0);
+        mvLength.push_back(0);
+        mvSlotTrackId.push_back(0);
+        mvSlotStamp.push_back(0);
+    }
+
+    mvHead[slot] = 0;
+    mvLength[slot] = 0;
+    mvSlotTrackId[slot] = nTrackId;
+    mmSlots[nTrackId] = slot;
+    return slot;
+}
+
+void TrackHistory::Update(const Frame &frame)
+{
+    TRACE_SCOPE("TrackHistory::Update");
+    mnStamp ++;
+
+    const size_t N = std::min(frame.mvTrackIds.size(), frame.mvKeysUn.size());
+    for(size_t i = 0; i < N; i++){
+        const uint64_t nTrackId = frame.mvTrackIds[i];
+        std::unordered_map<uint64_t, int>::const_iterator it = mmSlots.find(nTrackId);
+        const int slot = it == mmSlots.end()? AcquireSlot(nTrackId): it->second;
+
+        // the tracking state (ncc) is indexed by the keypoints of the last frame
+        float ncc = 1.0f;
+        const int idx = i < frame.mvPtIndexInLastFrame.size()? frame.mvPtIndexInLastFrame[i]: -1;
+        if(idx >= 0 && size_t(idx) < frame.mTracks.size())
+            ncc = frame.mTracks.ncc[idx];
+
+        sSample &s = mvSamples[size_t(slot) * mnDepth + mvHead[slot]];
+        s.pt = frame.mvKeysUn[i].pt;
+        s.t = frame.mTimeStamp;
+        s.ncc = ncc;
+        mvHead[slot] = (mvHead[slot] + 1) % mnDepth;
+        mvLength[slot] = std::min(mvLength[slot] + 1, mnDepth);
+        mvSlotStamp[slot] = mnStamp;
+    }
+
+    // release the lost tracks
+    for(std::unordered_map<uint64_t, int>::iterator it = mmSlots.begin(); it != mmSlots.end(); ){
+        if(mvSlotStamp[it->second] != mnStamp){
+            mvFreeSlots.push_back(it->second);
+            it = mmSlots.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+bool TrackHistory::GetHistory(uint64_t nTrackId, std::vector<sSample> &vSamples) const
+{
+    vSamples.clear();
+    std::unordered_map<uint64_t, int>::const_iterator it = mmSlots.find(nTrackId);
+    if(it == mmSlots.end())
+        return false;
+
+    const int slot = it->second;
+    const sSample* pRing = &mvSamples[size_t(slot) * mnDepth];
+    const int n = mvLength[slot];
+    vSamples.reserve(n);
+    for(int k = n; k > 0; k--)
+        vSamples.push_back(pRing[(mvHead[slot] - k + mnDepth) % mnDepth]);
+    return true;
+}
+
+int TrackHistory::GetLength(uint64_t nTrackId) const
+{
+    std::unordered_map<uint64_t, int>::const_iterator it = mmSlots.find(nTrackId);
+    return it == mmSlots.end()? 0: mvLength[it->second];
+}
@@ -0,0 +1,177 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tracking_mode_selector.h"
+#include "utils.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+
+const float DEG2RAD = M_PI / 180.0f;
+
+// Upper bounds of the motion handled by each level below the top one.
+// angle: rotation between the frames (rad); rate: peak angular rate (rad/s)
+struct sLevelBound{
+    float angle;
+    float rate;
+};
+const sLevelBound LEVEL_BOUNDS[] = {
+    {0.1f * DEG2RAD, 2.0f * DEG2RAD},      // GYRO_PREDICT: (nearly) static camera
+    {1.0f * DEG2RAD, 20.0f * DEG2RAD},     // GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED
+    {3.0f * DEG2RAD, 60.0f * DEG2RAD},     // GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION
+};
+
+const float TH_FAILURE = 0.4f;          // escalate one level above this ratio of lost tracks
+const float TH_FAILURE_PREDICT = 0.2f;  // GYRO_PREDICT only (no refinement) is not used above this ratio
+const float HYSTERESIS_SCALE = 0.7f;    // thresholds are scaled by this factor to go down
+const int DOWN_FRAMES = 5;              // consecutive adequate frames needed to go down one level
+const float FAILURE_SMOOTH = 0.3f;      // weight of the last frame in the failure rate
+const int NCC_SAMPLES = 32;             // tracks whose patches are compared per frame
+
+}
+
+TrackingModeSelector::TrackingModeSelector(GyroAidedTracker::eType maxType):
+    mnDownFrames(0), mfFailureRate(0.0f)
+{
+    // the ladder is only made of gyro-aided modes, whose eType values are ordered by cost
+    if(maxType == GyroAidedTracker::OPENCV_OPTICAL_FLOW_PYR_LK || maxType == GyroAidedTracker::IMAGE_ONLY_OPTICAL_FLOW_CONSIDER_ILLUMINATION){
+        LOG(WARNING) << "TrackingModeSelector: " << GetName(maxType) << " is not gyro-aided, the most robust mode is "
+                     << GetName(GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION);
+        maxType = GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION;
+    }
+
+    // the fixed levels cheaper than maxType, then maxType
+    const GyroAidedTracker::eType vLevels[] = {
+        GyroAidedTracker::GYRO_PREDICT,
+        GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED,
+        GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION
+    };
+    for(size_t i = 0; i < sizeof(vLevels) / sizeof(vLevels[0]) && vLevels[i] < maxType; i++)
+        mvLadder.push_back(vLevels[i]);
+    mvLadder.push_back(maxType);
+
+    // start with the most robust mode
+    mnLevel = mvLadder.size() - 1;
+}
+
+int TrackingModeSelector::RequiredLevel(float angle, float rate, float scale) const
+{
+    const int nTop = mvLadder.size() - 1;
+    int level = nTop;
+    for(int i = 0; i < nTop; i++){
+        if(angle < scale * LEVEL_BOUNDS[i].angle && rate < scale * LEVEL_BOUNDS[i].rate){
+            level = i;
+            break;
+        }
+    }
+
+    // the tracks are being lost, use a more robust model than the motion requires
+    if(level == 0 && mfFailureRate > scale * TH_FAILURE_PREDICT)
+        level = std::min(1, nTop);
+    if(mfFailureRate > scale * TH_FAILURE)
+        level = std::min(level + 1, nTop);
+
+    return level;
+}
+
+GyroAidedTracker::eType TrackingModeSelector::Select(const cv::Mat &Rcl, const std::vector<IMU::Point> &vImu,
+                                                     const cv::Point3f &biasg, double dt)
+{
+    float angle = 0.0f;
+    if(!Rcl.empty())
+        angle = cv::norm(IMU::LogSO3(Rcl));
+
+    // peak angular rate between the frames, the mean one if there is no measurement
+    float rate = 0.0f;
+    for(size_t i = 0; i < vImu.size(); i++)
+        rate = std::max(rate, float(cv::norm(vImu[i].w - biasg)));
+    if(vImu.empty() && dt > 0)
+        rate = angle / dt;
+
+    const int levelUp = RequiredLevel(angle, rate, 1.0f);
+    if(levelUp >= mnLevel){
+        mnLevel = levelUp;
+        mnDownFrames = 0;
+    }
+    else if(RequiredLevel(angle, rate, HYSTERESIS_SCALE) < mnLevel){
+        if(++mnDownFrames >= DOWN_FRAMES){
+            mnLevel--;
+            mnDownFrames = 0;
+        }
+    }
+    else
+        mnDownFrames = 0;
+
+    const GyroAidedTracker::eType type = mvLadder[mnLevel];
+    LOG(INFO) << "Tracking mode: " << GetName(type) << " (rotation: " << angle / DEG2RAD << " deg, rate: "
+              << rate / DEG2RAD << " deg/s, failure rate: " << mfFailureRate << ")";
+    return type;
+}
+
+void TrackingModeSelector::Update(const GyroAidedTracker &tracker, int nTracked)
+{
+    const int nRef = tracker.mvKeysRef.size();
+    if(nRef <= 0)
+        return;
+    const float tracked = std::min(1.0f, float(std::max(nTracked, 0)) / nRef);
+
+    // correlate the patches of a sample of the tracks, evenly spread over the features
+    const GyroAidedTracker::sResultsView results = tracker.GetResults();
+    const int nStep = std::max(1, nTracked / NCC_SAMPLES);
+    int nSampled = 0, nSimilar = 0;
+    for(size_t i = 0, k = 0; i < results.vStatus.size() && nSampled < NCC_SAMPLES; i++){
+        if(!results.vStatus[i] || (k++) % nStep)
+            continue;
+        const float ncc = NCC(tracker.mHalfPatchSize, tracker.mImgGrayRef, tracker.mImgGrayCur,
+                              tracker.mvKeysRef[i].pt, results.vPtPredict[i], cv::Mat());
+        nSampled ++;
+        if(ncc > GyroAidedTracker::TH_NCC_LOW)
+            nSimilar ++;
+    }
+    const float similar = nSampled > 0? float(nSimilar) / nSampled: 1.0f;
+
+    const float failure = 1.0f - tracked * similar;
+    mfFailureRate = FAILURE_SMOOTH * failure + (1.0f - FAILURE_SMOOTH) * mfFailureRate;
+}
+
+const char* TrackingModeSelector::GetName(GyroAidedTracker::eType type)
+{
+    switch(type){
+    case GyroAidedTracker::OPENCV_OPTICAL_FLOW_PYR_LK:
+        return "OPENCV_OPTICAL_FLOW_PYR_LK";
+    case GyroAidedTracker::GYRO_PREDICT:
+        return "GYRO_PREDICT";
+    case GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED:
+        return "GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED";
+    case GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION:
+        return "GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION";
+    case GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION:
+        return "GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION";
+    case GyroAidedTracker::GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION_REGULAR:
+        return "GYRO_PREDICT_WITH_OPTICAL_FLOW_REFINED_CONSIDER_ILLUMINATION_DEFORMATION_REGULAR";
+    case GyroAidedTracker::IMAGE_ONLY_OPTICAL_FLOW_CONSIDER_ILLUMINATION:
+        return "IMAGE_ONLY_OPTICAL_FLOW_CONSIDER_ILLUMINATION";
+    }
+    return "UNKNOWN";
+}
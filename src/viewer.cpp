@@ -0,0 +1,327 @@
+/**
+* This file is part of pixel_aware_gyro_aided_klt_feature_tracker.
+*
+* Copyright (C) 2015-2022 Weibo Huang <weibohuang@pku.edu.cn> (Peking University)
+* For more information see <https://gitee.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+* or <https://github.com/weibohuang/pixel_aware_gyro_aided_klt_feature_tracker>
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is a free software:
+* you can redistribute it and/or modify it under the terms of the GNU General
+* Public License as published by the Free Software Foundation, either version 3
+* of the License, or (at your option) any later version.
+*
+* pixel_aware_gyro_aided_klt_feature_tracker is distributed in the hope that
+* it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with pixel_aware_gyro_aided_klt_feature_tracker.
+* If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "viewer.h"
+#include <sys/stat.h>
+#include <errno.h>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include "frame.h"
+#include "trace.h"
+#include "../Thirdparty/glog/include/glog/logging.h"
+
+Viewer::Viewer(eMode mode, const std::string &winname, const std::string &output, double fps):
+    mMode(mode), mWinname(winname), mOutput(output), mfFps(fps), mbVideoFailed(false),
+    mnWrite(0), mnPending(1), mnDraw(2), mbPending(false), mbStop(false), mnKey(-1), mnDropped(0)
+{
+    if(mMode == IMAGES && mkdir(mOutput.c_str(), 0755) != 0 && errno != EEXIST)
+        LOG(ERROR) << "cannot create: " << mOutput;
+
+    if(mMode != NONE)
+        mThread = std::thread(&Viewer::Run, this);
+}
+
+Viewer::~Viewer()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mbStop = true;
+    }
+    mCond.notify_one();
+    if(mThread.joinable())
+        mThread.join();
+    mVideoWriter.release();
+
+    if(mnDropped > 0)
+        LOG(INFO) << "Viewer " << mWinname << ": dropped " << mnDropped << " frames";
+}
+
+void Viewer::Push(const Frame &frame, const sOptions &options)
+{
+    if(mMode == NONE)
+        return;
+
+    TRACE_SCOPE("Viewer::Push");
+
+    // mnWrite is owned by the tracking thread until it is published
+    TakeSnapshot(frame, options, mvSnapshots[mnWrite]);
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if(mbPending)
+            mnDropped ++;   // the viewer is behind, the stale snapshot is replaced
+        std::swap(mnWrite, mnPending);
+        mbPending = true;
+    }
+    mCond.notify_one();
+}
+
+void Viewer::Run()
+{
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if(mMode == WINDOW){
+                // keep the window responsive while waiting
+                while(!mbPending && !mbStop){
+                    lock.unlock();
+                    int key = cv::waitKey(1);
+                    if(key >= 0)
+                        mnKey = key;
+                    lock.lock();
+                }
+            }
+            else
+                mCond.wait(lock, [this]{return mbPending || mbStop;});
+
+            if(!mbPending)
+                return;     // stopped, and all the snapshots are drawn
+            std::swap(mnDraw, mnPending);
+            mbPending = false;
+        }
+
+        Output(mvSnapshots[mnDraw]);
+    }
+}
+
+void Viewer::Output(const sSnapshot &snapshot)
+{
+    TRACE_SCOPE("Viewer::Draw");
+    Draw(snapshot, mImage);
+
+    if(mMode == WINDOW){
+        cv::imshow(mWinname, mImage);
+        int key = cv::waitKey(1);
+        if(key >= 0)
+            mnKey = key;
+    }
+    else if(mMode == VIDEO){
+        if(!mVideoWriter.isOpened() && !mbVideoFailed){
+            mVideoWriter.open(mOutput, cv::VideoWriter::fourcc('M','J','P','G'), mfFps, mImage.size(), true);
+            mbVideoFailed = !mVideoWriter.isOpened();
+            if(mbVideoFailed)
+                LOG(ERROR) << "cannot open: " << mOutput;
+        }
+        if(mVideoWriter.isOpened())
+            mVideoWriter.write(mImage);
+    }
+    else if(mMode == IMAGES){
+        std::stringstream s;
+        s << mOutput << "/" << std::setw(6) << std::setfill('0') << snapshot.nId << ".png";
+        cv::imwrite(s.str(), mImage);
+    }
+}
+
+void Viewer::TakeSnapshot(const Frame &frame, const sOptions &options, sSnapshot &snapshot)
+{
+    const Frame &lastFrame = *frame.mpLastFrame;
+
+    snapshot.nId = frame.mnId;
+    snapshot.t = frame.mTimeStamp;
+    snapshot.options = options;
+    snapshot.nLastKeys = lastFrame.mvKeys.size();
+    snapshot.nRefKeys = frame.mvStatus.size();
+
+    // copyTo() reuses the buffers of the snapshot
+    lastFrame.mGray.copyTo(snapshot.grayLast);
+    frame.mGray.copyTo(snapshot.gray);
+
+    // the gyro predicted and patch-matched features, before the geometry validation
+    const std::vector<uchar> &vStatus = frame.mvStatusWithoutGeometryValid.empty()? frame.mvStatus: frame.mvStatusWithoutGeometryValid;
+    const size_t N = vStatus.size();
+    snapshot.vStatus.assign(vStatus.begin(), vStatus.end());
+    snapshot.vPtCur.assign(frame.mvPtPredictUn.begin(), frame.mvPtPredictUn.begin() + N);
+    snapshot.vPtRef.resize(N);
+    for(size_t i = 0; i < N; i++)
+        snapshot.vPtRef[i] = lastFrame.mvKeysUn[i].pt;
+    if(frame.mvPtGyroPredictUn.empty())
+        snapshot.vPtGyro.clear();
+    else
+        snapshot.vPtGyro.assign(frame.mvPtGyroPredictUn.begin(), frame.mvPtGyroPredictUn.begin() + N);
+
+    // good tracks after geometric validation, and their patches
+    snapshot.vGood.assign(N, 0);
+    snapshot.vPatches.clear();
+    const FeatureTable &tracks = frame.mTracks;
+    for(size_t i = 0, iend = frame.mvKeysUn.size(); i < iend; i++){
+        if(frame.mvKeysUn[i].size <= 1)    // new detected
+            continue;
+
+        const int idx = frame.mvPtIndexInLastFrame[i];
+        if(idx >= 0 && size_t(idx) < N)
+            snapshot.vGood[idx] = 1;
+
+        if(options.bDrawPatch && idx >= 0 && size_t(idx) < tracks.size() && tracks.predicted.Test(idx)){
+            sPatch patch;
+            patch.ptCur = frame.mvKeysUn[i].pt;
+            patch.ptRef = lastFrame.mvKeysUn[idx].pt;
+            for(int k = 0; k < 4; k++)
+                patch.corners[k] = cv::Point2f(tracks.uCorner[k][idx], tracks.vCorner[k][idx]);
+            snapshot.vPatches.push_back(patch);
+        }
+    }
+}
+
+void Viewer::Draw(const sSnapshot &snapshot, cv::Mat &im)
+{
+    cv::Scalar COLOR_BLUE(255, 0, 0);
+    cv::Scalar COLOR_GREEN(0, 255, 0);
+    cv::Scalar COLOR_RED(0, 0, 255);
+    cv::Scalar COLOR_WHITE(255, 255, 255);
+    cv::Scalar COLOR_YELLOW(0, 255, 255);
+
+    const sOptions &options = snapshot.options;
+    int margin = 10;
+    int h = snapshot.gray.rows, w = snapshot.gray.cols;
+    cv::Mat im_out = cv::Mat(h, 2 * w + margin, CV_8UC1, cv::Scalar(255));
+    snapshot.grayLast.copyTo(im_out.rowRange(0, h).colRange(0, w));
+    snapshot.gray.copyTo(im_out.rowRange(0, h).colRange(w+margin, 2*w+margin));
+
+    if(im_out.channels() < 3) //this should be always true
+        cv::cvtColor(im_out, im_out, cv::COLOR_GRAY2BGR);
+
+    // draw patches
+    for(size_t i = 0, iend = snapshot.vPatches.size(); i < iend; i++){
+        const sPatch &patch = snapshot.vPatches[i];
+
+        // on current frame
+        cv::Point2f pt_cur = patch.ptCur + cv::Point2f(w + margin,0);
+        cv::Point2f pt_tl = patch.corners[0] + pt_cur;
+        cv::Point2f pt_tr = patch.corners[1] + pt_cur;
+        cv::Point2f pt_bl = patch.corners[2] + pt_cur;
+        cv::Point2f pt_br = patch.corners[3] + pt_cur;
+
+        cv::line(im_out, pt_tl, pt_tr, COLOR_GREEN, 1, cv::LINE_AA);
+        cv::line(im_out, pt_tr, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
+        cv::line(im_out, pt_bl, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
+        cv::line(im_out, pt_tl, pt_bl, COLOR_GREEN, 1, cv::LINE_AA);
+
+        // on reference frame
+        cv::Point2f lr = pt_tr - pt_tl; int hw = int(sqrt(lr.x * lr.x + lr.y * lr.y)/2.0 + 0.5);
+        pt_tl = cv::Point2f(-hw, -hw) + patch.ptRef;
+        pt_tr = cv::Point2f(hw, -hw) + patch.ptRef;
+        pt_bl = cv::Point2f(-hw, hw) + patch.ptRef;
+        pt_br = cv::Point2f(hw, hw) + patch.ptRef;
+        cv::line(im_out, pt_tl, pt_tr, COLOR_GREEN, 1, cv::LINE_AA);
+        cv::line(im_out, pt_tr, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
+        cv::line(im_out, pt_bl, pt_br, COLOR_GREEN, 1, cv::LINE_AA);
+        cv::line(im_out, pt_tl, pt_bl, COLOR_GREEN, 1, cv::LINE_AA);
+    }
+
+    // tracked results
+    int circle_radius = 2;
+    int circle_thickness = -1;
+    int line_thickness = 1;
+    int cnt_total_tracks = 0, cnt_good_tracks = 0, cnt_bad_tracks = 0;
+
+    for(size_t i = 0, iend = snapshot.vStatus.size(); i < iend; i++){
+        cv::Point2f pt_cur = snapshot.vPtCur[i] + cv::Point2f(w+margin,0);
+        cv::Point2f pt_ref = snapshot.vPtRef[i];
+
+        if(!snapshot.vStatus[i]){ // Loss-tracked, red circle in reference frame
+            cv::circle(im_out, pt_ref, circle_radius, COLOR_BLUE, circle_thickness);
+            continue;
+        }
+
+        cnt_total_tracks ++;
+
+        if(options.bDrawMistracks && !snapshot.vGood[i]){   // Mistracked, red circle, red line
+            cnt_bad_tracks ++;
+
+            cv::circle(im_out, pt_cur, circle_radius, COLOR_RED, circle_thickness); // Bad track, red circle in reference frame
+            cv::circle(im_out, pt_ref, circle_radius, COLOR_RED, circle_thickness); // Bad track, red circle in current frame
+
+            // draw flows
+            if (options.drawFlowType == 0)      // flow on the current frame
+                cv::line(im_out, pt_ref + cv::Point2f(w+margin, 0), pt_cur, COLOR_RED, line_thickness, cv::LINE_AA);
+            else if (options.drawFlowType == 1) // line across two frames
+                cv::line(im_out, pt_ref, pt_cur, COLOR_RED, line_thickness, cv::LINE_AA);
+        }else {
+            cnt_good_tracks ++;
+
+            cv::circle(im_out, pt_ref, circle_radius, COLOR_GREEN, circle_thickness);   // Good track, green circle in reference frame
+            cv::circle(im_out, pt_cur, circle_radius, COLOR_GREEN, circle_thickness);   // Good track, green circle in current frame
+
+            // draw flows
+            if (options.drawFlowType == 0)      // flow on current frame
+                cv::line(im_out, pt_ref + cv::Point2f(w+margin, 0), pt_cur, COLOR_WHITE, line_thickness, cv::LINE_AA);
+            else if (options.drawFlowType == 1) // line across two frames
+                cv::line(im_out, pt_ref, pt_cur, COLOR_WHITE, line_thickness, cv::LINE_AA);
+        }
+
+        // draw gyro predict position
+        if(options.bDrawGyroPredictPosition && !snapshot.vPtGyro.empty()){
+             cv::Point2f pt_gyro = snapshot.vPtGyro[i] + cv::Point2f(w + margin,0);
+             if(pt_gyro.x != 0 && pt_gyro.y != 0){
+                 cv::circle(im_out, pt_gyro, circle_radius, COLOR_YELLOW, 1); // yellow circle
+             }
+        }
+    }
+
+
+    std::stringstream s;
+    int ref_kp_num = snapshot.nRefKeys;
+
+    s << std::fixed << std::setprecision(4)
+      << "Id: " << snapshot.nId
+      << ", T: " << std::to_string(snapshot.t)
+      << ", RGT: " << 100.0 * cnt_good_tracks / ref_kp_num << "%"
+      << ", RGP: " << 100.0 * cnt_good_tracks / cnt_total_tracks << "%"
+         ;
+
+    cv::Size textSize = cv::getTextSize(s.str(),cv::FONT_HERSHEY_PLAIN,1,1,0);
+    im.create(im_out.rows + textSize.height + 10, im_out.cols, im_out.type());
+    im_out.copyTo(im.rowRange(0, im_out.rows).colRange(0, im_out.cols));
+    im.rowRange(im_out.rows, im.rows) = cv::Scalar::all(0);
+
+    cv::Scalar txt_color_fg(255, 255, 255);
+    cv::Scalar txt_color_bg(0, 0, 0);
+
+    cv::putText(im, s.str(), cv::Point(5, im.rows-5), cv::FONT_HERSHEY_PLAIN, 1, txt_color_fg, 1.0, cv::LINE_AA);
+
+    std::vector<std::string> vTxt;
+    if(!snapshot.vPtGyro.empty()){
+        vTxt.push_back("Gyro-Aided KLT Feature Tracking");
+    }
+    else {  // for OPENCV_OPTICAL_FLOW_PYR_LK
+        vTxt.push_back("Image-only KLT Feature Tracking");
+    }
+
+    vTxt.push_back("ID: " + std::to_string(snapshot.nId));
+    vTxt.push_back("Keypoints: " + std::to_string(snapshot.nLastKeys));
+    vTxt.push_back("Tracks: " + std::to_string(cnt_total_tracks)
+                   + " (G: " + std::to_string(cnt_good_tracks) + " | B: " + std::to_string(cnt_bad_tracks) + ")" );
+    std::stringstream s_rgt; s_rgt << std::fixed << std::setprecision(2) << "RGT: " << 100.0 * cnt_good_tracks / ref_kp_num << "%";
+    std::stringstream s_rgp; s_rgp << std::fixed << std::setprecision(2) << "RGP: " << 100.0 * cnt_good_tracks / cnt_total_tracks << "%";
+    vTxt.push_back(s_rgt.str() + ", " + s_rgp.str());
+
+    double sc = std::min(h/640.0, 2.0);    // scale factor for consistent visualization across scales
+    int Ht = int(sc * 30);
+    for (size_t i = 0, iend = vTxt.size(); i < iend; i++) {
+        cv::putText(im, vTxt[i], cv::Point(int(8*sc) + w + margin, Ht*(i+1)), cv::FONT_HERSHEY_DUPLEX, 1.0*sc, txt_color_bg, 2.0, cv::LINE_AA);
+        cv::putText(im, vTxt[i], cv::Point(int(8*sc) + w + margin, Ht*(i+1)), cv::FONT_HERSHEY_DUPLEX, 1.0*sc, txt_color_fg, 1.0, cv::LINE_AA);
+    }
+}